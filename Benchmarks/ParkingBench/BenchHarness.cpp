@@ -0,0 +1,104 @@
+//
+//  BenchHarness.cpp
+//  ParkingBench
+//
+
+#include "BenchHarness.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <new>
+#include <ctime>
+
+using namespace std;
+using json = nlohmann::json;
+
+// MARK: Счетчик аллокаций
+
+atomic<size_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    allocationCount++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// MARK: Харнесс
+
+BenchResult BenchHarness::summarize(const string& name, vector<double>& samples, const BenchOptions& options, size_t allocations) {
+    BenchResult result;
+    result.name = name;
+    result.samples = samples.size();
+    result.opsPerSample = options.opsPerSample;
+    if (samples.empty()) return result;
+    
+    sort(samples.begin(), samples.end());
+    
+    auto percentile = [&samples](double p) {
+        size_t index = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+        return samples[index];
+    };
+    
+    double sum = 0;
+    for (double s : samples) sum += s;
+    
+    result.meanNs = sum / samples.size();
+    result.p50Ns = percentile(0.50);
+    result.p90Ns = percentile(0.90);
+    result.p99Ns = percentile(0.99);
+    result.maxNs = samples.back();
+    result.allocationsPerOp = static_cast<double>(allocations) / (samples.size() * options.opsPerSample);
+    return result;
+}
+
+void BenchHarness::printHeader() const {
+    out << left << setw(36) << "benchmark" << right
+         << setw(12) << "p50 ns" << setw(12) << "p90 ns" << setw(12) << "p99 ns"
+         << setw(12) << "max ns" << setw(10) << "alloc/op" << "\n";
+}
+
+void BenchHarness::print(const BenchResult& r) const {
+    out << left << setw(36) << r.name << right << fixed << setprecision(1)
+         << setw(12) << r.p50Ns << setw(12) << r.p90Ns << setw(12) << r.p99Ns
+         << setw(12) << r.maxNs << setw(10) << setprecision(2) << r.allocationsPerOp << "\n";
+}
+
+bool BenchHarness::writeJson(const string& path) const {
+    json report;
+    report["timestamp"] = time(nullptr);
+    report["results"] = json::array();
+    
+    for (const auto& r : results) {
+        report["results"].push_back({
+            {"name", r.name},
+            {"samples", r.samples},
+            {"ops_per_sample", r.opsPerSample},
+            {"mean_ns", r.meanNs},
+            {"p50_ns", r.p50Ns},
+            {"p90_ns", r.p90Ns},
+            {"p99_ns", r.p99Ns},
+            {"max_ns", r.maxNs},
+            {"allocations_per_op", r.allocationsPerOp}
+        });
+    }
+    
+    ofstream file(path);
+    if (!file.is_open()) {
+        out << "Ошибка, не получилось открыть файл " << path << "\n";
+        return false;
+    }
+    file << report.dump(2) << "\n";
+    return true;
+}
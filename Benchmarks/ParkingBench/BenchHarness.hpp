@@ -0,0 +1,100 @@
+//
+//  BenchHarness.hpp
+//  ParkingBench
+//
+//  Минимальный харнесс: прогрев, замеры пачками, перцентили, аллокации, вывод в JSON.
+//
+
+#ifndef BenchHarness_hpp
+#define BenchHarness_hpp
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <ostream>
+#include "json.hpp"
+
+using namespace std;
+
+// Считает global operator new (определен в BenchHarness.cpp)
+extern atomic<size_t> allocationCount;
+
+struct BenchResult {
+    string name;
+    size_t samples = 0;
+    size_t opsPerSample = 0;
+    double meanNs = 0;
+    double p50Ns = 0;
+    double p90Ns = 0;
+    double p99Ns = 0;
+    double maxNs = 0;
+    double allocationsPerOp = 0;
+};
+
+struct BenchOptions {
+    size_t warmupSamples = 20;
+    size_t samples = 200;
+    // Если опер. очень быстрая (CRC 8 байт), мерим пачку, чтобы не мерить сами часы
+    size_t opsPerSample = 1;
+};
+
+class BenchHarness {
+public:
+    // Отчет пишем в отдельный поток: cout на замерах заглушен от логов контроллера
+    explicit BenchHarness(ostream& output) : out(output) {}
+    
+    // Опции по умолчанию для всех замеров (можно поменять из командной строки)
+    BenchOptions defaults;
+    
+    template <typename Fn>
+    const BenchResult& run(const string& name, Fn&& op, BenchOptions options) {
+        for (size_t i = 0; i < options.warmupSamples * options.opsPerSample; i++) {
+            op();
+        }
+        
+        vector<double> samples;
+        samples.reserve(options.samples);
+        size_t allocationsBefore = allocationCount;
+        
+        for (size_t i = 0; i < options.samples; i++) {
+            auto start = chrono::steady_clock::now();
+            for (size_t j = 0; j < options.opsPerSample; j++) {
+                op();
+            }
+            auto elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+            samples.push_back(elapsed / options.opsPerSample);
+        }
+        
+        // Сам vector samples уже выделен до замера, так что эти аллокации - только от op()
+        size_t allocations = allocationCount - allocationsBefore;
+        
+        results.push_back(summarize(name, samples, options, allocations));
+        print(results.back());
+        return results.back();
+    }
+    
+    template <typename Fn>
+    const BenchResult& run(const string& name, Fn&& op, size_t opsPerSample = 1) {
+        BenchOptions options = defaults;
+        options.opsPerSample = opsPerSample;
+        return run(name, forward<Fn>(op), options);
+    }
+    
+    const vector<BenchResult>& all() const { return results; }
+    
+    void printHeader() const;
+    // Машиночитаемый отчет, чтобы сравнивать релизы
+    bool writeJson(const string& path) const;
+    
+private:
+    ostream& out;
+    vector<BenchResult> results;
+    
+    static BenchResult summarize(const string& name, vector<double>& samples, const BenchOptions& options, size_t allocations);
+    void print(const BenchResult& result) const;
+};
+
+#endif /* BenchHarness_hpp */
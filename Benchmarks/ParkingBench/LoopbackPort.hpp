@@ -0,0 +1,69 @@
+//
+//  LoopbackPort.hpp
+//  ParkingBench
+//
+
+#ifndef LoopbackPort_hpp
+#define LoopbackPort_hpp
+
+#include <cstring>
+#include <algorithm>
+#include "ICommunication.h"
+#include "BarrierModel.hpp"
+
+using namespace std;
+
+// Порт, за которым сразу стоит модель шлагбаума. Ответ готов к моменту следующего чтения.
+// Часы виртуальные: каждый запрос сдвигает время на step, поэтому стрела доезжает за один опрос
+// и цикл открыть/закрыть не ждет реального движения.
+class LoopbackPort: public ICommunication {
+private:
+    BarrierModel barrier;
+    BarrierModel::Clock::time_point virtualNow;
+    chrono::milliseconds step;
+    
+    uint8_t reply[256];
+    size_t replyLength = 0;
+    size_t replyOffset = 0;
+    
+    // Загрузка линии
+    size_t bytesOnLine = 0;
+    size_t transactions = 0;
+public:
+    explicit LoopbackPort(uint8_t slaveId = 1, int travelTimeMs = 1, chrono::milliseconds virtualStep = chrono::milliseconds(1000))
+        : barrier(slaveId, travelTimeMs), step(virtualStep) {}
+    
+    bool connect(const string&) override { return true; }
+    void disconnect() override {}
+    void flush() override { replyLength = replyOffset = 0; }
+    
+    bool sendBytes(const uint8_t* data, size_t length) override {
+        virtualNow += step;
+        bytesOnLine += length;
+        transactions++;
+        
+        replyLength = barrier.handleRtu(data, length, reply, virtualNow);
+        replyOffset = 0;
+        bytesOnLine += replyLength;
+        return true;
+    }
+    
+    int readAvailable(uint8_t* buffer, int capacity, int) override {
+        int n = min<int>(capacity, static_cast<int>(replyLength - replyOffset));
+        memcpy(buffer, reply + replyOffset, n);
+        replyOffset += n;
+        return n;
+    }
+    
+    int readBytes(uint8_t* buffer, int expected, int) override {
+        return readAvailable(buffer, expected, 0);
+    }
+    
+    // Модель за портом: датчик проезда выставляет бенчмарк
+    BarrierModel& model() { return barrier; }
+    
+    size_t lineBytes() const { return bytesOnLine; }
+    size_t transactionsCount() const { return transactions; }
+};
+
+#endif /* LoopbackPort_hpp */
@@ -0,0 +1,203 @@
+//
+//  TcpLoopback.hpp
+//  ParkingBench
+//
+
+#ifndef TcpLoopback_hpp
+#define TcpLoopback_hpp
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "BarrierModel.hpp"
+#include "ModbusFramer.hpp"
+
+// На macOS нет MSG_NOSIGNAL
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+
+// Шлюз Ethernet -> RS-485 в том же процессе (как TcpBarrier): 127.0.0.1 на свободном порту,
+// за ним модель шлагбаума. Ответы можно портить так, как это бывает за настоящим шлюзом:
+// отдавать кусками, подмешивать чужую транзакцию, отвечать на два запроса в обратном порядке
+class TcpLoopbackGateway {
+public:
+    enum class Mode {
+        Normal,
+        Split,    // Ответ тремя кусками, MBAP заголовок разрезан
+        Stray,    // Перед ответом - такой же, но с чужим Transaction ID и другими данными (только Modbus TCP)
+        Reverse   // Держим ответ, пока не придет второй запрос, и отдаем оба одной пачкой задом наперед
+    };
+
+private:
+    bool rtu;
+    BarrierModel barrier;
+    int listenFd = -1;
+    int port = 0;
+    thread worker;
+    atomic<bool> running{false};
+    atomic<Mode> mode{Mode::Normal};
+    atomic<size_t> requests{0};
+
+    vector<uint8_t> pending;
+    ModbusRtuFramer framer{9600, ModbusRtuFramer::Direction::Request};
+    vector<uint8_t> held;
+
+    static bool sendAll(int fd, const uint8_t* data, size_t length) {
+        while (length > 0) {
+            ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            data += n;
+            length -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void deliver(int fd, const uint8_t* reply, size_t length) {
+        switch (mode.load()) {
+            case Mode::Split: {
+                // 3 байта, 4 байта, остальное: у Modbus TCP первый кусок - половина MBAP
+                size_t cuts[] = {min<size_t>(3, length), min<size_t>(7, length), length};
+                size_t sent = 0;
+                for (size_t cut : cuts) {
+                    if (cut <= sent) continue;
+                    sendAll(fd, reply + sent, cut - sent);
+                    sent = cut;
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                }
+                break;
+            }
+            case Mode::Stray: {
+                vector<uint8_t> stray(reply, reply + length);
+                stray[0] ^= 0x40;
+                stray[length - 1] ^= 0x03;
+                sendAll(fd, stray.data(), stray.size());
+                sendAll(fd, reply, length);
+                break;
+            }
+            case Mode::Reverse: {
+                if (held.empty()) {
+                    held.assign(reply, reply + length);
+                    break;
+                }
+                vector<uint8_t> both(reply, reply + length);
+                both.insert(both.end(), held.begin(), held.end());
+                held.clear();
+                sendAll(fd, both.data(), both.size());
+                break;
+            }
+            default:
+                sendAll(fd, reply, length);
+                break;
+        }
+    }
+
+    // Modbus TCP: целые ADU из накопленного
+    void handleTcp(int fd) {
+        while (pending.size() >= 7) {
+            size_t length = (pending[4] << 8) | pending[5];
+            size_t aduLength = 6 + length;
+            if (pending.size() < aduLength) break;
+
+            uint8_t reply[7 + BarrierModel::maxPduSize];
+            memcpy(reply, pending.data(), 7);
+            size_t pduLength = barrier.handlePdu(pending.data() + 7, length - 1, reply + 7);
+            reply[4] = ((pduLength + 1) >> 8) & 0xFF;
+            reply[5] = (pduLength + 1) & 0xFF;
+            pending.erase(pending.begin(), pending.begin() + aduLength);
+
+            requests++;
+            deliver(fd, reply, 7 + pduLength);
+        }
+    }
+
+    void handleRtu(int fd, const uint8_t* data, size_t length) {
+        framer.feed(data, length);
+
+        ModbusRtuFrame frame;
+        while (framer.nextFrame(frame)) {
+            uint8_t reply[256];
+            size_t replyLength = barrier.handleRtu(frame.data, frame.length, reply);
+            requests++;
+            if (replyLength > 0) deliver(fd, reply, replyLength);
+        }
+    }
+
+    void serve() {
+        int clientFd = -1;
+        while (running) {
+            pollfd pfd = {clientFd == -1 ? listenFd : clientFd, POLLIN, 0};
+            if (poll(&pfd, 1, 20) <= 0) continue;
+
+            if (clientFd == -1) {
+                clientFd = accept(listenFd, nullptr, nullptr);
+                int noDelay = 1;
+                if (clientFd != -1) setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                continue;
+            }
+
+            uint8_t buffer[512];
+            ssize_t n = recv(clientFd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                close(clientFd);
+                clientFd = -1;
+                continue;
+            }
+            if (rtu) {
+                handleRtu(clientFd, buffer, static_cast<size_t>(n));
+            } else {
+                pending.insert(pending.end(), buffer, buffer + n);
+                handleTcp(clientFd);
+            }
+        }
+        if (clientFd != -1) close(clientFd);
+    }
+
+public:
+    // rtuOverTcp - прозрачный шлюз (RTU кадры с CRC), иначе Modbus TCP
+    explicit TcpLoopbackGateway(bool rtuOverTcp = false, uint8_t slaveId = 1) : rtu(rtuOverTcp), barrier(slaveId) {
+        framer.setGapDetection(false);
+    }
+
+    ~TcpLoopbackGateway() {
+        running = false;
+        if (worker.joinable()) worker.join();
+        if (listenFd != -1) close(listenFd);
+    }
+
+    bool start() {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd == -1) return false;
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t addrLength = sizeof(addr);
+        if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listenFd, 1) != 0 ||
+            getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLength) != 0) {
+            return false;
+        }
+        port = ntohs(addr.sin_port);
+
+        running = true;
+        worker = thread([this]() { serve(); });
+        return true;
+    }
+
+    string address() const { return "127.0.0.1:" + to_string(port); }
+    void setMode(Mode next) { mode = next; }
+    size_t requestsCount() const { return requests; }
+};
+
+#endif /* TcpLoopback_hpp */
@@ -0,0 +1,908 @@
+//
+//  main.cpp
+//  ParkingBench
+//
+//  Бенчмарк горячих путей: CRC, кодирование/разбор кадров, цикл шлагбаума,
+//  запись истории в SQLite, сборка ответов API. Внешние сервисы не нужны:
+//  SQLite в памяти, шлагбаум - модель за loopback портом или за симулированной
+//  линией RS-485 (тайминги 9600 бод, потери байт - в виртуальном времени).
+//
+//  ParkingBench [--json results.json] [--samples N] [--replay capture.pkcap]
+//  ParkingBench --capture sample.pkcap    - записать образец обмена и выйти
+//
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <atomic>
+#include "BenchHarness.hpp"
+#include "LoopbackPort.hpp"
+#include "TcpLoopback.hpp"
+#include "ModbusUtils.hpp"
+#include "ModbusFramer.hpp"
+#include "GateController.hpp"
+#include "Database.hpp"
+#include "ApiResponses.hpp"
+#include "WireCapture.hpp"
+#include "SimulatedLine.hpp"
+#include "GateStateCache.hpp"
+#include "GateCommandQueue.hpp"
+#include "TimerWheel.hpp"
+#include "LaneMetrics.hpp"
+#include "ModbusBusMaster.hpp"
+#include "GateGroup.hpp"
+#include "ModbusTcpTransport.hpp"
+#include "RfidReader.hpp"
+
+using namespace std;
+
+// Глушилка для cout (логи контроллера на замерах)
+class NullBuffer: public streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+};
+
+// Чтобы компилятор не выкинул результат
+static volatile uint16_t sink;
+static volatile size_t sinkSize;
+
+// MARK: Проверки
+
+// Полный цикл открыть/опросить/закрыть не должен трогать кучу
+bool checkGateCycleAllocations() {
+    LoopbackPort port;
+    GateController controller(port, 1);
+    
+    // Прогрев (iostream и пр. могут аллоцировать при первом выводе)
+    controller.openGate();
+    controller.closeGate();
+    
+    size_t before = allocationCount;
+    controller.openGate();
+    int position = controller.getGatePosition();
+    controller.closeGate();
+    size_t allocations = allocationCount - before;
+    
+    cout << "--- Цикл open/poll/close ---\n";
+    cout << "position=" << position << " allocations=" << allocations << "\n";
+    return position == 100 && allocations == 0;
+}
+
+// Несколько шлагбаумов на одной симулированной линии через ModbusBusMaster.
+// Пока master стоит, вызывающие уходят по бюджету очереди, и их запросы на линию потом не попадают.
+// Дальше все опрашивают разом с тем же окном ответа - очередь его не проедает: каждый получает
+// ответ своего slave, чужих ответов нет.
+// Линию трогает только поток master, поэтому однопоточной симуляции это подходит
+bool checkBusMaster() {
+    const int slavesCount = 8;
+    const int replyTimeoutMs = 40;
+    
+    SimulatedLine line;
+    vector<unique_ptr<SimulatedBarrier>> barriers;
+    for (int id = 1; id <= slavesCount; id++) {
+        barriers.push_back(make_unique<SimulatedBarrier>(line, id, 3000));
+    }
+    
+    ModbusBusMaster bus(line.master());
+    bus.setQueueTimeout(replyTimeoutMs);
+    vector<unique_ptr<GateController>> controllers;
+    for (int id = 1; id <= slavesCount; id++) {
+        controllers.push_back(make_unique<GateController>(bus.channel(id), id));
+        controllers.back()->setReplyTimeout(replyTimeoutMs);
+    }
+    
+    auto pollAll = [&controllers](vector<GateState>& states) {
+        vector<thread> pollers;
+        for (size_t i = 0; i < controllers.size(); i++) {
+            pollers.emplace_back([&controllers, &states, i]() { states[i] = controllers[i]->readState(); });
+        }
+        for (auto& poller : pollers) poller.join();
+    };
+    
+    NullBuffer nullBuffer;
+    streambuf* errors = cerr.rdbuf(&nullBuffer);
+    
+    vector<GateState> stalled(slavesCount);
+    auto started = chrono::steady_clock::now();
+    pollAll(stalled);
+    auto waitedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count();
+    
+    // Команда, снятая из очереди, на линии не была - автомат фаз не ждет от нее движения
+    bool unsentFailed = false;
+    try {
+        controllers[0]->closeGate();
+    } catch (const runtime_error&) {
+        unsentFailed = true;
+    }
+    bool unsentMarked = controllers[0]->phase() == GatePhase::Closing;
+    
+    // Между запросами master выдерживает t3.5 по настоящим часам - восемь опросов в очереди
+    // в 40 мс не уложатся, но окно ответа считается с отправки, а очереди дан свой бюджет
+    bus.setQueueTimeout(1000);
+    bus.start();
+    vector<GateState> states(slavesCount);
+    pollAll(states);
+    bus.stop();
+    cerr.rdbuf(errors);
+    
+    int stalledValid = 0, valid = 0;
+    size_t stale = 0;
+    uint64_t cancelled = 0;
+    for (int i = 0; i < slavesCount; i++) {
+        if (stalled[i].valid) stalledValid++;
+        if (states[i].valid && states[i].isClosed) valid++;
+        stale += controllers[i]->staleFramesCount();
+        cancelled += bus.stats(i + 1).cancelled;
+    }
+    size_t onLine = barriers[0]->requestsCount();
+    
+    cout << "--- Шина на " << slavesCount << " шлагбаумов (ModbusBusMaster, симуляция) ---\n";
+    cout << "master стоит: ответов " << stalledValid << ", ушли за " << waitedMs << " мс (дедлайн " << replyTimeoutMs
+         << "), снято из очереди " << cancelled << ", неушедшее закрытие " << (unsentFailed && !unsentMarked ? "ошибка" : "принято") << "\n";
+    cout << "master работает: ответов " << valid << ", чужих кадров " << stale
+         << ", запросов на линии " << onLine << "\n";
+    return stalledValid == 0 && waitedMs < replyTimeoutMs * 3 && cancelled == slavesCount + 1
+        && unsentFailed && !unsentMarked && valid == slavesCount && stale == 0 && onLine == 2 * slavesCount;
+}
+
+// Группы на одной линии с тремя шлагбаумами (виртуальное время). Вся линия - один broadcast кадр
+// и фазы у всех участников; часть линии - команды по адресам, третий не трогаем
+bool checkGateGroup() {
+    SimulatedLine line;
+    vector<unique_ptr<SimulatedBarrier>> barriers;
+    vector<unique_ptr<GateController>> controllers;
+    for (uint8_t id = 1; id <= 3; id++) {
+        barriers.push_back(make_unique<SimulatedBarrier>(line, id, 3000));
+        controllers.push_back(make_unique<GateController>(line.master(), id));
+        controllers.back()->setClock([&line]() { return line.now(); },
+                                     [&line](chrono::milliseconds duration) { line.advance(duration); });
+    }
+    vector<uint8_t> lineSlaves = {1, 2, 3};
+    GateGroup everyone(line.master(), {controllers[0].get(), controllers[1].get(), controllers[2].get()}, lineSlaves);
+    GateGroup pair(line.master(), {controllers[0].get(), controllers[1].get()}, lineSlaves);
+    
+    NullBuffer nullBuffer;
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    streambuf* errors = cerr.rdbuf(&nullBuffer);
+    
+    uint64_t before = line.master().busStats().transactions;
+    bool broadcastSent = everyone.commandAll(true);
+    uint64_t broadcastFrames = line.master().busStats().transactions - before;
+    bool allOpened = everyone.waitForAll(true, 10000);
+    
+    // У первого своя очередь: проезд по RFID при открытом шлагбауме ставит автозакрытие,
+    // групповое закрытие его снимает. Очередь не запущена, на линию она не ходит
+    TimerWheel timers(chrono::milliseconds(10));
+    GateCommandQueue firstQueue(*controllers[0]);
+    firstQueue.setAutoClose(timers, chrono::seconds(5));
+    pair.addQueue(firstQueue);
+    firstQueue.submit(GateCommand::Open, nullptr, true);
+    bool autoCloseArmed = firstQueue.autoClosePending();
+    
+    before = line.master().busStats().transactions;
+    bool pairSent = pair.commandAll(false);
+    bool autoCloseDropped = !firstQueue.autoClosePending();
+    uint64_t pairFrames = line.master().busStats().transactions - before;
+    bool pairClosed = pair.waitForAll(false, 10000);
+    line.advance(chrono::seconds(5));
+    
+    cout.rdbuf(console);
+    cerr.rdbuf(errors);
+    
+    bool phasesOpen = allOpened && controllers[2]->phase() == GatePhase::Open;
+    bool pairPhases = controllers[0]->phase() == GatePhase::Closed && controllers[1]->phase() == GatePhase::Closed;
+    bool thirdUntouched = barriers[2]->barrier().isOpen() && barriers[2]->barrier().coil();
+    bool pairModels = barriers[0]->barrier().isClosed() && barriers[1]->barrier().isClosed();
+    
+    cout << "--- Группа шлагбаумов (3 slave на линии, симуляция) ---\n";
+    cout << "вся линия: broadcast " << (everyone.usesBroadcast() ? "да" : "нет") << ", кадров команды " << broadcastFrames
+         << ", открыты " << (phasesOpen ? "все" : "не все") << "\n";
+    cout << "двое из трех: broadcast " << (pair.usesBroadcast() ? "да" : "нет") << ", кадров команды " << pairFrames
+         << ", закрыты " << (pairClosed && pairPhases && pairModels ? "оба" : "не оба")
+         << ", третий " << (thirdUntouched ? "открыт" : "сдвинулся")
+         << ", автозакрытие " << (autoCloseArmed && autoCloseDropped ? "снято" : "осталось") << "\n";
+    return autoCloseArmed && autoCloseDropped && everyone.usesBroadcast() && broadcastSent && broadcastFrames == 1 && phasesOpen
+        && !pair.usesBroadcast() && pairSent && pairFrames == 2 && pairClosed && pairPhases && pairModels && thirdUntouched;
+}
+
+// TCP транспорты против шлюза в том же процессе. Modbus TCP: ответ кусками (MBAP разрезан),
+// чужой Transaction ID перед настоящим ответом, два запроса в полете с ответами в обратном порядке.
+// RTU over TCP: тот же кадр с CRC кусками
+bool checkTcpTransports() {
+    NullBuffer nullBuffer;
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    streambuf* errors = cerr.rdbuf(&nullBuffer);
+    
+    TcpLoopbackGateway gateway;
+    ModbusTcpTransport tcp;
+    bool connected = gateway.start() && tcp.connect(gateway.address());
+    GateController controller(tcp, 1);
+    controller.setReplyTimeout(500);
+    
+    gateway.setMode(TcpLoopbackGateway::Mode::Split);
+    GateState split = controller.readState();
+    
+    // Чужой ответ говорит "открыт" и другое положение - пройти он не должен
+    gateway.setMode(TcpLoopbackGateway::Mode::Stray);
+    GateState stray = controller.readState();
+    size_t unmatched = tcp.unmatchedCount();
+    
+    gateway.setMode(TcpLoopbackGateway::Mode::Reverse);
+    ModbusFrame::Buffer limits = ReadLimitsFrame::forSlave(1);
+    ModbusFrame::Buffer position = ReadPositionFrame::forSlave(1);
+    int first = tcp.submit(limits.data(), limits.size());
+    int second = tcp.submit(position.data(), position.size());
+    uint8_t limitsReply[16], positionReply[16];
+    int positionLength = second < 0 ? -1 : tcp.awaitReply(static_cast<uint16_t>(second), positionReply, sizeof(positionReply), 500);
+    int limitsLength = first < 0 ? -1 : tcp.awaitReply(static_cast<uint16_t>(first), limitsReply, sizeof(limitsReply), 500);
+    bool pipelined = limitsLength == 6 && limitsReply[1] == 0x02 && positionLength == 7 && positionReply[1] == 0x04
+        && tcp.inFlight() == 0;
+    
+    TcpLoopbackGateway rtuGateway(true);
+    RtuOverTcpTransport rtu;
+    bool rtuConnected = rtuGateway.start() && rtu.connect(rtuGateway.address());
+    GateController rtuController(rtu, 1);
+    rtuController.setReplyTimeout(500);
+    rtuGateway.setMode(TcpLoopbackGateway::Mode::Split);
+    GateState rtuSplit = rtuController.readState();
+    
+    cout.rdbuf(console);
+    cerr.rdbuf(errors);
+    
+    auto closedAt0 = [](const GateState& state) { return state.valid && state.isClosed && !state.isOpen && state.position == 0; };
+    cout << "--- TCP транспорты (шлюз в процессе) ---\n";
+    cout << "Modbus TCP: по кускам " << (closedAt0(split) ? "ok" : "сбой") << ", с чужой транзакцией "
+         << (closedAt0(stray) ? "ok" : "сбой") << " (отброшено " << unmatched << "), конвейер из двух "
+         << (pipelined ? "ok" : "сбой") << "\n";
+    cout << "RTU over TCP: по кускам " << (closedAt0(rtuSplit) ? "ok" : "сбой") << "\n";
+    return connected && rtuConnected && closedAt0(split) && closedAt0(stray) && unmatched == 2 && pipelined
+        && closedAt0(rtuSplit) && controller.staleFramesCount() == 0;
+}
+
+// Загрузка шины на одно полное чтение состояния: три отдельных опроса против readState()
+void reportSnapshotBusUsage() {
+    // 8N1: 10 бит на символ
+    auto lineMs = [](size_t bytes, int baud) { return bytes * 10 * 1000.0 / baud; };
+    
+    LoopbackPort before;
+    GateController oldController(before, 1);
+    oldController.isGateOpen();
+    oldController.isGateClose();
+    oldController.getGatePosition();
+    
+    LoopbackPort after;
+    GateController newController(after, 1);
+    newController.readState();
+    
+    cout << "--- Состояние шлагбаума: загрузка шины (9600 бод) ---\n";
+    cout << "3 опроса:   " << before.transactionsCount() << " транзакции, " << before.lineBytes()
+         << " байт, " << lineMs(before.lineBytes(), 9600) << " мс на линии\n";
+    cout << "readState: " << after.transactionsCount() << " транзакции, " << after.lineBytes()
+         << " байт, " << lineMs(after.lineBytes(), 9600) << " мс на линии\n";
+}
+
+// Несколько потоков (/status, мониторинг, автозакрытие) опрашивают один шлагбаум.
+// Каждый обмен целиком держит шину, остальные ждут по очереди - смотрим сколько
+void reportBusContention() {
+    const int threadsCount = 4;
+    const int pollsPerThread = 2000;
+    
+    LoopbackPort port;
+    GateController controller(port, 1);
+    atomic<int> failed{0};
+    
+    vector<thread> pollers;
+    for (int t = 0; t < threadsCount; t++) {
+        pollers.emplace_back([&]() {
+            for (int i = 0; i < pollsPerThread; i++) {
+                if (!controller.readState().valid) failed++;
+            }
+        });
+    }
+    for (auto& poller : pollers) poller.join();
+    
+    BusStats stats = port.busStats();
+    cout << "--- Очередь на шину: " << threadsCount << " потока по " << pollsPerThread << " опросов ---\n";
+    cout << "обменов: " << stats.transactions << ", без ответа: " << stats.timeouts
+         << ", чужих ответов: " << controller.staleFramesCount() << ", ошибок опроса: " << failed << "\n";
+    cout << "ожидание очереди: среднее " << stats.averageQueueWaitUs() << " мкс, максимум " << stats.maxQueueWaitUs << " мкс\n";
+}
+
+// Читатели состояния (/status) через кеш: обменов с шлагбаумом столько, сколько решил опросчик,
+// сколько бы ни было клиентов
+void reportCacheReaders() {
+    cout << "--- Кеш состояния: читатели за 500 мс ---\n";
+    
+    for (int readers : {1, 8, 64}) {
+        LoopbackPort port;
+        GateController controller(port, 1);
+        GateStateCache cache(controller);
+        cache.start();
+        
+        atomic<bool> stop{false};
+        atomic<uint64_t> reads{0};
+        vector<thread> clients;
+        for (int t = 0; t < readers; t++) {
+            clients.emplace_back([&]() {
+                while (!stop) {
+                    sinkSize = cache.snapshot().state.position;
+                    reads++;
+                }
+            });
+        }
+        this_thread::sleep_for(chrono::milliseconds(500));
+        stop = true;
+        for (auto& client : clients) client.join();
+        cache.stop();
+        
+        cout << "читателей " << readers << ": чтений " << reads << ", обменов " << port.busStats().transactions << "\n";
+    }
+}
+
+// Шквал /open и /close от нескольких клиентов: раньше - поток на запрос, теперь один исполнитель.
+// Смотрим, сколько команд реально ушло на шину, сколько склеено и сколько получили бы 429
+void reportCommandFlood() {
+    const int clientsCount = 8;
+    const int requestsPerClient = 500;
+    
+    LoopbackPort port;
+    GateController controller(port, 1);
+    controller.setClock([]() { return chrono::steady_clock::now(); }, [](chrono::milliseconds) {});
+    GateCommandQueue queue(controller, 4);
+    
+    NullBuffer nullBuffer;
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    streambuf* errors = cerr.rdbuf(&nullBuffer);
+    queue.start();
+    
+    atomic<int> completed{0};
+    atomic<int64_t> maxQueuedMs{0};
+    vector<thread> clients;
+    for (int t = 0; t < clientsCount; t++) {
+        clients.emplace_back([&, t]() {
+            mt19937 random(t);
+            for (int i = 0; i < requestsPerClient; i++) {
+                GateCommand command = random() % 2 ? GateCommand::Open : GateCommand::Close;
+                queue.submit(command, [&](const GateCommandResult& result) {
+                    int64_t queued = result.queued.count();
+                    int64_t seen = maxQueuedMs;
+                    while (queued > seen && !maxQueuedMs.compare_exchange_weak(seen, queued)) {}
+                    completed++;
+                });
+            }
+        });
+    }
+    for (auto& client : clients) client.join();
+    queue.stop();
+    
+    cout.rdbuf(console);
+    cerr.rdbuf(errors);
+    
+    GateCommandStats stats = queue.stats();
+    cout << "--- Очередь команд: " << clientsCount << " клиентов по " << requestsPerClient << " запросов ---\n";
+    cout << "ответов " << completed << ", на шину " << stats.executed << ", склеено " << stats.coalesced
+         << ", 429: " << stats.rejected << ", ошибок " << stats.failed << "\n";
+    cout << "потоков-исполнителей 1 (было " << clientsCount * requestsPerClient << "), глубина до " << stats.maxDepth
+         << ", ожидание в очереди до " << maxQueuedMs << " мс, обменов " << port.busStats().transactions << "\n";
+}
+
+// Три проезда по RFID подряд с интервалом меньше времени удержания: раньше - три потока и три
+// закрытия (первое - перед второй машиной), теперь один таймер продлевается и закрытие одно
+void reportAutoClose() {
+    const auto holdOpen = chrono::milliseconds(200);
+    
+    LoopbackPort port;
+    GateController controller(port, 1);
+    controller.setClock([]() { return chrono::steady_clock::now(); }, [](chrono::milliseconds) {});
+    TimerWheel timers(chrono::milliseconds(10));
+    GateCommandQueue queue(controller);
+    queue.setAutoClose(timers, holdOpen);
+    
+    NullBuffer nullBuffer;
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    timers.start();
+    queue.start();
+    
+    for (int scan = 0; scan < 3; scan++) {
+        queue.submitAsync(GateCommand::Open, true).wait();
+        this_thread::sleep_for(holdOpen / 2);
+    }
+    GatePhase heldPhase = controller.phase();
+    this_thread::sleep_for(holdOpen * 2);
+    
+    queue.stop();
+    timers.stop();
+    cout.rdbuf(console);
+    
+    GateCommandStats stats = queue.stats();
+    cout << "--- Автозакрытие: 3 проезда через " << (holdOpen / 2).count() << " мс, удержание " << holdOpen.count() << " мс ---\n";
+    cout << "фаза между проездами " << gatePhaseName(heldPhase) << ", закрытий " << stats.autoCloses
+         << ", продлений " << stats.autoCloseExtended << ", в конце " << gatePhaseName(controller.phase()) << "\n";
+}
+
+// Час пик: машины идут одна за другой. Закрытие по времени держит полосу открытой весь
+// timeout_open_gate, по датчику проезда - пока машина проезжает и еще clearDelay.
+// Время в масштабе: удержание 400 мс вместо 5 с, проезд 100 мс
+void reportLaneThroughput() {
+    const int carsCount = 5;
+    const auto holdOpen = chrono::milliseconds(400);
+    const auto clearDelay = chrono::milliseconds(50);
+    
+    cout << "--- Полоса: " << carsCount << " машин подряд, удержание " << holdOpen.count() << " мс ---\n";
+    
+    for (bool withSensor : {false, true}) {
+        LoopbackPort port;
+        GateController controller(port, 1);
+        controller.setClock([]() { return chrono::steady_clock::now(); }, [](chrono::milliseconds) {});
+        GateStateMachine::Timing timing;
+        timing.vehiclePoll = chrono::milliseconds(10);
+        controller.states().setTiming(timing);
+        
+        TimerWheel timers(chrono::milliseconds(10));
+        GateStateCache cache(controller);
+        GateCommandQueue queue(controller);
+        queue.setAutoClose(timers, holdOpen);
+        if (withSensor) {
+            controller.setVehicleSensor(3);
+            queue.setVehicleClose(clearDelay);
+        }
+        
+        LaneMetrics lane;
+        controller.states().addListener([&lane](GatePhase phase) {
+            if (phase == GatePhase::Open) lane.gateOpened();
+            else if (phase == GatePhase::Closed) lane.gateClosed();
+        });
+        controller.states().addVehicleListener([&lane](bool present) {
+            if (!present) lane.vehiclePassed();
+        });
+        
+        NullBuffer nullBuffer;
+        streambuf* console = cout.rdbuf(&nullBuffer);
+        timers.start();
+        cache.start();
+        queue.start();
+        
+        auto started = chrono::steady_clock::now();
+        for (int car = 0; car < carsCount; car++) {
+            queue.submitAsync(GateCommand::Open, true).wait();
+            this_thread::sleep_for(chrono::milliseconds(20));
+            port.model().setVehiclePresent(true);
+            this_thread::sleep_for(chrono::milliseconds(80));
+            port.model().setVehiclePresent(false);
+            
+            // Следующая машина подъезжает к закрытому шлагбауму
+            auto deadline = chrono::steady_clock::now() + holdOpen * 3;
+            while (cache.snapshot().phase != GatePhase::Closed && chrono::steady_clock::now() < deadline) {
+                this_thread::sleep_for(chrono::milliseconds(2));
+            }
+        }
+        double minutes = chrono::duration<double, ratio<60>>(chrono::steady_clock::now() - started).count();
+        
+        queue.stop();
+        cache.stop();
+        timers.stop();
+        cout.rdbuf(console);
+        
+        GateCommandStats stats = queue.stats();
+        cout << (withSensor ? "по датчику: " : "по времени: ") << carsCount / minutes << " машин/мин, закрытий по датчику "
+             << stats.vehicleCloses << " из " << stats.autoCloses << ", цикл в среднем " << lane.stats().averageCycle.count()
+             << " мс, обменов " << port.busStats().transactions << "\n";
+    }
+}
+
+// Пик: разрешенные машины через 200 мс (в масштабе - через пару секунд). Без колонны шлагбаум
+// закрывается за каждой и открывается перед следующей; в колонне стоит открытым, а разрешения
+// только продлевают таймер. Считаем механические циклы и команды на шину
+void reportConvoy() {
+    const int carsCount = 10;
+    const auto gap = chrono::milliseconds(200);
+    
+    cout << "--- Колонна: " << carsCount << " машин через " << gap.count() << " мс ---\n";
+    
+    for (bool convoyEnabled : {false, true}) {
+        LoopbackPort port;
+        GateController controller(port, 1);
+        controller.setClock([]() { return chrono::steady_clock::now(); }, [](chrono::milliseconds) {});
+        GateStateMachine::Timing timing;
+        timing.vehiclePoll = chrono::milliseconds(10);
+        controller.states().setTiming(timing);
+        controller.setVehicleSensor(3);
+        
+        TimerWheel timers(chrono::milliseconds(10));
+        GateStateCache cache(controller);
+        GateCommandQueue queue(controller);
+        queue.setAutoClose(timers, chrono::milliseconds(400));
+        queue.setVehicleClose(chrono::milliseconds(50));
+        if (convoyEnabled) {
+            // 3 разрешения за 2 с - колонна
+            ConvoySettings convoy;
+            convoy.enterPerMinute = 90;
+            convoy.window = chrono::milliseconds(2000);
+            convoy.hold = chrono::milliseconds(300);
+            convoy.vehiclePoll = chrono::milliseconds(30);
+            queue.setConvoy(convoy);
+        }
+        
+        LaneMetrics lane;
+        controller.states().addListener([&lane](GatePhase phase) {
+            if (phase == GatePhase::Open) lane.gateOpened();
+            else if (phase == GatePhase::Closed) lane.gateClosed();
+        });
+        
+        NullBuffer nullBuffer;
+        streambuf* console = cout.rdbuf(&nullBuffer);
+        timers.start();
+        cache.start();
+        queue.start();
+        
+        auto arrival = chrono::steady_clock::now();
+        for (int car = 0; car < carsCount; car++) {
+            this_thread::sleep_until(arrival);
+            queue.submitAsync(GateCommand::Open, true).wait();
+            this_thread::sleep_for(chrono::milliseconds(20));
+            port.model().setVehiclePresent(true);
+            this_thread::sleep_for(chrono::milliseconds(80));
+            port.model().setVehiclePresent(false);
+            arrival += gap;
+        }
+        // Последняя проехала - ждем закрытия
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+        while (cache.snapshot().phase != GatePhase::Closed && chrono::steady_clock::now() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(2));
+        }
+        
+        queue.stop();
+        cache.stop();
+        timers.stop();
+        cout.rdbuf(console);
+        
+        GateCommandStats stats = queue.stats();
+        cout << (convoyEnabled ? "колонна:    " : "без колонны: ") << "циклов " << lane.stats().cycles << ", команд на шину "
+             << stats.executed << ", склеено " << stats.coalesced << ", обменов " << port.busStats().transactions
+             << ", разрешений в колонне " << stats.convoyArrivals << "\n";
+    }
+}
+
+// Циклы открыть/закрыть через симулированную линию 9600 бод с потерями байт.
+// Время виртуальное: результат одинаков на любой машине и при любом seed того же значения
+void reportSimulatedLine() {
+    cout << "--- Симуляция линии 9600 бод (100 циклов, виртуальное время) ---\n";
+    
+    for (double loss : {0.0, 0.001, 0.01}) {
+        SimulatedLine::Options options;
+        options.lossRate = loss;
+        SimulatedLine line(options);
+        SimulatedBarrier gate(line, 1, 3000);
+        GateController controller(line.master(), 1);
+        controller.setClock([&line]() { return line.now(); },
+                            [&line](chrono::milliseconds duration) { line.advance(duration); });
+        
+        NullBuffer nullBuffer;
+        streambuf* console = cout.rdbuf(&nullBuffer);
+        size_t failed = 0;
+        for (int i = 0; i < 100; i++) {
+            try {
+                controller.openGate();
+                controller.closeGate();
+                GateState state = controller.readState();
+                if (!state.valid || !state.isClosed) failed++;
+            } catch (const exception&) {
+                failed++;
+            }
+        }
+        cout.rdbuf(console);
+        
+        auto virtualSeconds = chrono::duration_cast<chrono::milliseconds>(line.now().time_since_epoch()).count() / 1000.0;
+        BusStats stats = line.master().busStats();
+        cout << "потери " << loss * 100 << "%: сбоев циклов " << failed
+             << ", обменов на цикл " << stats.transactions / 100.0
+             << ", таймаутов " << stats.timeouts
+             << ", мусора " << controller.garbageBytesCount() << " байт"
+             << ", виртуально " << virtualSeconds << " с\n";
+    }
+}
+
+// MARK: Замеры
+
+void benchCRC(BenchHarness& bench) {
+    mt19937 rng(42);
+    
+    for (size_t size : { 6, 256, 4096 }) {
+        vector<uint8_t> data(size);
+        for (auto& b : data) b = static_cast<uint8_t>(rng());
+        
+        // Все варианты должны совпасть с эталоном
+        uint16_t reference = ModbusUtils::calculateCRCBitwise(data.data(), size);
+        if (ModbusUtils::calculateCRCTable(data.data(), size) != reference ||
+            ModbusUtils::calculateCRCSlice4(data.data(), size) != reference ||
+            ModbusUtils::calculateCRCSlice8(data.data(), size) != reference ||
+            ModbusUtils::calculateCRC(data.data(), size) != reference) {
+            cerr << "Ошибка: CRC не совпал с эталоном на " << size << " байтах\n";
+            exit(1);
+        }
+        
+        const uint8_t* p = data.data();
+        size_t batch = max<size_t>(1, 4096 / size);
+        string suffix = "/" + to_string(size);
+        
+        bench.run("crc/bitwise" + suffix, [p, size]() { sink = ModbusUtils::calculateCRCBitwise(p, size); }, batch);
+        bench.run("crc/table" + suffix, [p, size]() { sink = ModbusUtils::calculateCRCTable(p, size); }, batch);
+        bench.run("crc/slice4" + suffix, [p, size]() { sink = ModbusUtils::calculateCRCSlice4(p, size); }, batch);
+        bench.run("crc/slice8" + suffix, [p, size]() { sink = ModbusUtils::calculateCRCSlice8(p, size); }, batch);
+        bench.run("crc/dispatch" + suffix, [p, size]() { sink = ModbusUtils::calculateCRC(p, size); }, batch);
+    }
+}
+
+void benchFrames(BenchHarness& bench) {
+    ModbusFrame frame = { 1, Command::READ_INPUT_REGISTERS, 0x0000, Action::ONE_REGISTER };
+    ModbusFrame::Buffer buffer;
+    
+    bench.run("frame/serialize_vector", [&frame]() { sinkSize = frame.serialize().size(); }, 256);
+    bench.run("frame/encode_array", [&frame, &buffer]() { frame.encode(buffer); sink = buffer[6]; }, 256);
+    bench.run("frame/precomputed_lookup", []() { sink = ReadPositionFrame::forSlave(1)[6]; }, 256);
+    
+    // Ответ на чтение IR0
+    uint8_t reply[7] = { 0x01, 0x04, 0x02, 0x00, 0x37, 0x00, 0x00 };
+    uint16_t crc = ModbusUtils::calculateCRC(reply, 5);
+    reply[5] = crc & 0xFF;
+    reply[6] = (crc >> 8) & 0xFF;
+    
+    ModbusRtuFramer framer;
+    bench.run("framer/parse_reply", [&framer, &reply]() {
+        ModbusRtuFrame parsed;
+        framer.feed(reply, sizeof(reply));
+        if (framer.nextFrame(parsed)) sinkSize = parsed.length;
+    }, 256);
+}
+
+void benchGate(BenchHarness& bench) {
+    LoopbackPort port;
+    GateController controller(port, 1);
+    // Время у loopback идет запросами, паузы между опросами только мешают замеру
+    controller.setClock([]() { return chrono::steady_clock::now(); }, [](chrono::milliseconds) {});
+    
+    bench.run("gate/read_state", [&controller]() { sinkSize = controller.readState().position; }, 64);
+    
+    // Автозакрытие на каждый проезд: поставить и продлить таймер, при закрытии - снять
+    TimerWheel timers;
+    bench.run("timer/schedule_extend_cancel", [&timers]() {
+        TimerWheel::TimerId id = timers.schedule(chrono::seconds(5), []() {});
+        timers.reschedule(id, chrono::seconds(5));
+        sinkSize = timers.cancel(id);
+    }, 256);
+    bench.run("gate/open_close_cycle", [&controller]() {
+        controller.openGate();
+        controller.closeGate();
+    }, 16);
+    
+    // То же с включенной записью обмена - цена захвата на горячем пути
+    LoopbackPort capturedPort;
+    CaptureTransport capture(capturedPort);
+    GateController capturedController(capture, 1);
+    string capturePath = "/tmp/parking_bench.pkcap";
+    if (capture.start(capturePath)) {
+        bench.run("gate/read_state_captured", [&capturedController]() { sinkSize = capturedController.readState().position; }, 64);
+        capture.stop();
+        remove(capturePath.c_str());
+    }
+    
+    // Тот же цикл, но с таймингами линии: сколько стоит симуляция, чтобы гонять ее тысячами
+    SimulatedLine line;
+    SimulatedBarrier simulated(line, 1, 3000);
+    GateController simulatedController(line.master(), 1);
+    simulatedController.setClock([&line]() { return line.now(); },
+                                 [&line](chrono::milliseconds duration) { line.advance(duration); });
+    bench.run("sim/open_close_cycle", [&simulatedController]() {
+        simulatedController.openGate();
+        simulatedController.closeGate();
+    }, 1);
+}
+
+const int sampleCaptureCards = 10;
+
+// Проезд как его делает ParkingSystem, но синхронно: карта - открыть, закрыть
+void passVehicle(GateController& controller) {
+    try {
+        controller.openGate();
+        controller.readState();
+        controller.closeGate();
+        controller.readState();
+    } catch (const exception&) {
+        // Расхождение с записью - его считает ReplayTransport
+    }
+}
+
+// Записать несколько проездов - образец для --replay: карта со считывателя (канал Rfid)
+// и цикл шлагбаума за ней
+bool writeSampleCapture(const string& path) {
+    LoopbackPort port;
+    CaptureTransport capture(port);
+    GateController controller(capture, 1);
+    const uint8_t card[] = "0004521337\r\n";
+    
+    if (!capture.start(path)) return false;
+    for (int i = 0; i < sampleCaptureCards; i++) {
+        capture.record(WireCapture::Channel::Rfid, WireCapture::Direction::Rx, card, sizeof(card) - 1);
+        passVehicle(controller);
+    }
+    capture.stop();
+    return true;
+}
+
+// Сессия из захвата заново: карты - в RfidReader::feed, его колбэк ведет шлагбаум через ReplayTransport.
+// Сколько карт прочитали
+size_t replaySession(ReplayTransport& replay, CapturePlayer& cards) {
+    GateController controller(replay, 1);
+    RfidReader reader;
+    size_t cardsRead = 0;
+    reader.setCallBack([&controller, &cardsRead](string) {
+        cardsRead++;
+        passVehicle(controller);
+    });
+    
+    replay.rewind();
+    cards.rewind();
+    cards.playDue([&reader](const uint8_t* data, size_t length) { reader.feed(data, length); });
+    return cardsRead;
+}
+
+// Захват с двумя каналами: RFID и шлагбаум не путаются, карты из записи запускают те же обмены
+bool checkSessionReplay() {
+    const string path = "/tmp/parking_bench_session.pkcap";
+    
+    NullBuffer nullBuffer;
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    streambuf* errors = cerr.rdbuf(&nullBuffer);
+    
+    ReplayTransport replay(0);
+    CapturePlayer cards(WireCapture::Channel::Rfid, 0);
+    bool loaded = writeSampleCapture(path) && replay.connect(path) && cards.load(path);
+    size_t cardsRead = loaded ? replaySession(replay, cards) : 0;
+    remove(path.c_str());
+    
+    cout.rdbuf(console);
+    cerr.rdbuf(errors);
+    
+    cout << "--- Replay сессии (RFID и шлагбаум из одного захвата) ---\n";
+    cout << "карт " << cardsRead << " из " << cards.size() << ", расхождений запросов " << replay.mismatchCount()
+         << ", захват " << (replay.finished() ? "проигран целиком" : "проигран не весь") << "\n";
+    return loaded && cards.size() == sampleCaptureCards && cardsRead == sampleCaptureCards
+        && replay.mismatchCount() == 0 && replay.finished();
+}
+
+// Прогон записанного обмена: те же запросы, записанные ответы без пауз, разбор фреймером.
+// Реальные трассы с объекта как регрессионный вход
+void benchReplay(BenchHarness& bench, const string& path) {
+    ReplayTransport replay(0);
+    if (!replay.connect(path)) return;
+    
+    size_t replies = 0;
+    auto replayAll = [&replay, &replies]() {
+        replay.rewind();
+        replies = 0;
+        
+        while (const vector<uint8_t>* request = replay.nextRequest()) {
+            ModbusRtuFramer framer;
+            auto collect = [&framer](const uint8_t* data, size_t length, chrono::steady_clock::time_point arrivedAt) {
+                framer.feed(data, length, arrivedAt);
+                ModbusRtuFrame frame;
+                return framer.nextFrame(frame);
+            };
+            auto deadline = chrono::steady_clock::now() + chrono::milliseconds(50);
+            if (replay.transact(request->data(), request->size(), ReplySpec::from(collect), deadline) == TransactResult::Replied) replies++;
+        }
+    };
+    
+    bench.run("replay/capture", replayAll, 1);
+    cerr << "[Replay] " << path << ": ответов " << replies << ", расхождений запросов " << replay.mismatchCount() << "\n";
+    
+    // Вся сессия: карты из записи через RfidReader, шлагбаум - через записанные ответы
+    CapturePlayer cards(WireCapture::Channel::Rfid, 0);
+    if (cards.load(path)) {
+        size_t cardsRead = replaySession(replay, cards);
+        cerr << "[Replay] карт " << cardsRead << ", расхождений запросов " << replay.mismatchCount() << "\n";
+    }
+}
+
+void benchDatabase(BenchHarness& bench) {
+    Database db(":memory:");
+    
+    bench.run("db/log_event", [&db]() { db.logEvent("Controller", "Шлагбаум открыт", 1); }, 16);
+    bench.run("db/get_history_json", [&db]() { sinkSize = db.getHistory().dump().size(); });
+}
+
+void benchApi(BenchHarness& bench) {
+    GateState state;
+    state.valid = true;
+    state.isOpen = true;
+    state.position = 100;
+    
+    bench.run("api/status_json", [&state]() { sinkSize = ApiResponses::status(state, 0).dump().size(); }, 64);
+    
+    // /status из кеша: снимок без шины + тело ответа
+    LoopbackPort port;
+    GateController controller(port, 1);
+    GateStateCache cache(controller);
+    cache.freshSnapshot(chrono::milliseconds(0), chrono::milliseconds(0));
+    bench.run("cache/snapshot", [&cache]() { sinkSize = cache.snapshot().state.position; }, 256);
+    bench.run("api/status_cached_json", [&cache]() {
+        GateSnapshot snapshot = cache.snapshot();
+        sinkSize = ApiResponses::status(snapshot, 0, snapshot.age() > chrono::milliseconds(2000)).dump().size();
+    }, 64);
+    bench.run("api/ws_event_json", []() {
+        sinkSize = ApiResponses::event("GATE_UPDATE", { {"position", 42}, {"open", false}, {"closed", false} }).dump().size();
+    }, 64);
+}
+
+int main(int argc, const char * argv[]) {
+    string jsonPath;
+    string replayPath;
+    ostream report(cout.rdbuf());
+    BenchHarness bench(report);
+    
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+        else if (arg == "--samples" && i + 1 < argc) bench.defaults.samples = stoul(argv[++i]);
+        else if (arg == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (arg == "--capture" && i + 1 < argc) {
+            // Только записать образец и выйти
+            return writeSampleCapture(argv[++i]) ? 0 : 1;
+        }
+    }
+    
+    if (!checkGateCycleAllocations()) {
+        cerr << "Ошибка: цикл шлагбаума аллоцирует память\n";
+        return 1;
+    }
+    if (!checkBusMaster()) {
+        cerr << "Ошибка: master шины отдал чужой ответ или выпустил на линию просроченный запрос\n";
+        return 1;
+    }
+    if (!checkGateGroup()) {
+        cerr << "Ошибка: групповая команда задела шлагбаум вне группы или фазы не сошлись\n";
+        return 1;
+    }
+    if (!checkTcpTransports()) {
+        cerr << "Ошибка: TCP транспорт неверно собрал или сопоставил ответ\n";
+        return 1;
+    }
+    if (!checkSessionReplay()) {
+        cerr << "Ошибка: replay захвата разошелся с записью\n";
+        return 1;
+    }
+    reportSnapshotBusUsage();
+    reportBusContention();
+    reportCacheReaders();
+    reportCommandFlood();
+    reportAutoClose();
+    reportLaneThroughput();
+    reportConvoy();
+    reportSimulatedLine();
+    
+    report << "--- Замеры ---\n";
+    bench.printHeader();
+    
+    // Логи контроллера в консоль на замерах не нужны
+    NullBuffer nullBuffer;
+    streambuf* console = cout.rdbuf(&nullBuffer);
+    
+    benchCRC(bench);
+    benchFrames(bench);
+    benchGate(bench);
+    benchDatabase(bench);
+    benchApi(bench);
+    if (!replayPath.empty()) {
+        benchReplay(bench, replayPath);
+    }
+    
+    cout.rdbuf(console);
+    
+    if (!jsonPath.empty() && bench.writeJson(jsonPath)) {
+        cout << "Результаты записаны в " << jsonPath << "\n";
+    }
+    
+    return 0;
+}
@@ -54,6 +54,9 @@ class BarrierEmulator:
         self.lbl_di2 = tk.Label(frame_data, text="DI[2] (Is Open): 0")
         self.lbl_di2.pack(anchor="w", pady=5)
 
+        self.lbl_di3 = tk.Label(frame_data, text="DI[3] (Vehicle): 0")
+        self.lbl_di3.pack(anchor="w", pady=5)
+
 
         # 3. Управление датчиками (Simulate Inputs)
         frame_controls = tk.LabelFrame(self.root, text="Управление датчиками")
@@ -66,6 +69,11 @@ class BarrierEmulator:
         self.sensor_val = tk.BooleanVar()
         self.btn_sensor.config(variable=self.sensor_val)
 
+        # Индукционная петля / фотоэлемент в створе (vehicle_sensor_di=3)
+        self.vehicle_val = tk.BooleanVar()
+        self.btn_vehicle = tk.Checkbutton(frame_controls, text="Машина в створе (DI[3])", variable=self.vehicle_val, command=self.toggle_vehicle)
+        self.btn_vehicle.pack(pady=5)
+
         self.updateUI()
     
     
@@ -79,6 +87,14 @@ class BarrierEmulator:
         store.setValues(1, 0, [1 if val else 0])
         log.info(f"Датчик открытия установлен в: {val}")
 
+    def toggle_vehicle(self):
+        store = self.get_store()
+        val = self.vehicle_val.get()
+
+        store.setValues(2, 3, [1 if val else 0])
+        self.lbl_di3.config(text=f"DI[3] (Vehicle): {1 if val else 0}")
+        log.info(f"Машина в створе: {val}")
+
     # Вызываем каждые 200мс для обновления UI
     def updateUI(self):
         store = self.get_store()
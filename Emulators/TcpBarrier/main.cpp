@@ -0,0 +1,162 @@
+//
+//  main.cpp
+//  TcpBarrier
+//
+//  Эмулятор шлагбаума за Ethernet -> RS-485 шлюзом.
+//  Режим Modbus TCP (по умолчанию) или RTU over TCP (--rtu), без железа и socat.
+//
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "BarrierModel.hpp"
+#include "ModbusFramer.hpp"
+#include "ModbusUtils.hpp"
+
+using namespace std;
+
+struct Client {
+    // Запросы приходят из сокета: паузы между пакетами - сеть, а не линия
+    explicit Client(int socket) : fd(socket) { framer.setGapDetection(false); }
+    
+    int fd;
+    // Modbus TCP: недочитанный ADU
+    vector<uint8_t> pending;
+    // RTU over TCP: свой фреймер на каждое соединение
+    ModbusRtuFramer framer{9600, ModbusRtuFramer::Direction::Request};
+};
+
+bool sendAll(int fd, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(fd, data, length, 0);
+        if (n <= 0) return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Modbus TCP: MBAP + PDU
+bool handleTcp(Client& client, BarrierModel& barrier) {
+    while (client.pending.size() >= 7) {
+        const uint8_t* adu = client.pending.data();
+        size_t length = (adu[4] << 8) | adu[5];
+        size_t aduLength = 6 + length;
+        if (length < 2 || length > 254) return false;
+        if (client.pending.size() < aduLength) break;
+        
+        uint8_t reply[7 + BarrierModel::maxPduSize];
+        memcpy(reply, adu, 7);
+        
+        // Unit ID не наш - молчим, как настоящий шлюз по таймауту. Broadcast выполняем без ответа
+        if (adu[6] == ModbusBroadcastAddress && barrier.address() != ModbusBroadcastAddress) {
+            barrier.handlePdu(adu + 7, length - 1, reply + 7);
+        } else if (adu[6] == barrier.address()) {
+            size_t pduLength = barrier.handlePdu(adu + 7, length - 1, reply + 7);
+            reply[4] = ((pduLength + 1) >> 8) & 0xFF;
+            reply[5] = (pduLength + 1) & 0xFF;
+            if (!sendAll(client.fd, reply, 7 + pduLength)) return false;
+        }
+        
+        client.pending.erase(client.pending.begin(), client.pending.begin() + aduLength);
+    }
+    return true;
+}
+
+// RTU over TCP: те же кадры с CRC, что и по RS-485
+bool handleRtu(Client& client, BarrierModel& barrier, const uint8_t* data, size_t length) {
+    client.framer.feed(data, length);
+    
+    ModbusRtuFrame frame;
+    while (client.framer.nextFrame(frame)) {
+        uint8_t reply[256];
+        size_t replyLength = barrier.handleRtu(frame.data, frame.length, reply);
+        if (replyLength > 0 && !sendAll(client.fd, reply, replyLength)) return false;
+    }
+    return true;
+}
+
+int main(int argc, const char * argv[]) {
+    int port = 5020;
+    int slaveId = 0;
+    bool rtuMode = false;
+    
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--rtu") rtuMode = true;
+        else if (arg == "--id" && i + 1 < argc) slaveId = stoi(argv[++i]);
+        else port = stoi(arg);
+    }
+    
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    
+    if (::bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 8) != 0) {
+        cerr << "Ошибка: порт " << port << " занят\n";
+        return 1;
+    }
+    
+    cout << "Шлагбаум (slave " << slaveId << ") слушает 127.0.0.1:" << port
+         << (rtuMode ? " [RTU over TCP]" : " [Modbus TCP]") << "\n";
+    
+    BarrierModel barrier(static_cast<uint8_t>(slaveId));
+    vector<Client> clients;
+    
+    while (true) {
+        vector<pollfd> fds;
+        fds.push_back({ listenFd, POLLIN, 0 });
+        for (auto& c : clients) fds.push_back({ c.fd, POLLIN, 0 });
+        
+        if (poll(fds.data(), fds.size(), 100) < 0) continue;
+        
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                int noDelay = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                clients.emplace_back(fd);
+                cout << "Клиент подключился\n";
+            }
+        }
+        
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            
+            Client& client = clients[i - 1];
+            uint8_t buffer[512];
+            ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+            
+            bool ok = n > 0;
+            if (ok && rtuMode) {
+                ok = handleRtu(client, barrier, buffer, n);
+            } else if (ok) {
+                client.pending.insert(client.pending.end(), buffer, buffer + n);
+                ok = handleTcp(client, barrier);
+            }
+            
+            if (!ok) {
+                close(client.fd);
+                client.fd = -1;
+                cout << "Клиент отключился\n";
+            }
+        }
+        
+        clients.erase(remove_if(clients.begin(), clients.end(), [](const Client& c) { return c.fd == -1; }), clients.end());
+    }
+    
+    return 0;
+}
@@ -0,0 +1,49 @@
+//
+//  ApiResponses.hpp
+//  Parking
+//
+
+#ifndef ApiResponses_hpp
+#define ApiResponses_hpp
+
+#include <stdio.h>
+#include <string>
+#include "json.hpp"
+#include "GateController.hpp"
+#include "GateStateCache.hpp"
+#include "GateCommandQueue.hpp"
+#include "GateGroup.hpp"
+#include "LaneMetrics.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+// Тела ответов REST API и событий WebSocket.
+// Вынесены из NetworkServer, чтобы их можно было собирать и мерить без uWebSockets.
+class ApiResponses {
+public:
+    // GET /status
+    static json status(const GateState& state, int deviceId);
+    // GET /status из кеша: плюс фаза, возраст снимка и stale, если он старше запрошенного
+    static json status(const GateSnapshot& snapshot, int deviceId, bool stale);
+    // POST /open, /close
+    static json accepted();
+    // POST /open?wait=1, /close?wait=1 - исход команды
+    static json commandResult(const GateCommandResult& result);
+    // 429: очередь команд полна
+    static json busy(size_t depth);
+    // POST /group/open, /group/close - исход групповой команды (событие GROUP_COMMAND)
+    static json groupResult(const GateGroupResult& result);
+    // 429: группа еще выполняет прошлую команду
+    static json groupBusy();
+    // 404: группа не настроена (group_barrier_ids)
+    static json noGroup();
+    // 401
+    static json unauthorized();
+    // Пропускная способность полосы (событие LANE_METRICS) и режим колонны
+    static json laneMetrics(const LaneStats& stats, bool convoy);
+    // Событие для broadcast в WebSocket
+    static json event(const string& eventType, const json& data);
+};
+
+#endif /* ApiResponses_hpp */
@@ -0,0 +1,60 @@
+//
+//  BarrierModel.hpp
+//  Parking
+//
+
+#ifndef BarrierModel_hpp
+#define BarrierModel_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <atomic>
+
+using namespace std;
+
+// Модель шлагбаума-slave на C++ (как fake_barrier.py, только без UI).
+// Coil[0] - команда (1 - открыть, 0 - закрыть), DI1 - закрыт, DI2 - открыт, IR0 - положение стрелы в %.
+// DI3 - датчик проезда (петля/фотоэлемент), его выставляет тот, кто моделирует машины.
+// Время передается снаружи, поэтому модель работает и с виртуальными часами.
+class BarrierModel {
+public:
+    using Clock = chrono::steady_clock;
+    
+    // Максимальный PDU по стандарту (256 - адрес - CRC)
+    static constexpr size_t maxPduSize = 253;
+    
+    explicit BarrierModel(uint8_t slaveId = 0, int travelTimeMs = 5000);
+    
+    // PDU запроса -> PDU ответа (без адреса и CRC). Возвращает длину ответа
+    size_t handlePdu(const uint8_t* pdu, size_t length, uint8_t* reply, Clock::time_point now = Clock::now());
+    // Целый RTU кадр -> RTU ответ с CRC. 0 - кадр не нам или broadcast (на него не отвечают)
+    size_t handleRtu(const uint8_t* frame, size_t length, uint8_t* reply, Clock::time_point now = Clock::now());
+    
+    // Двигаем стрелу до момента now
+    void update(Clock::time_point now);
+    
+    uint8_t address() const { return slaveId; }
+    bool coil() const { return openCommand; }
+    int position() const { return static_cast<int>(positionPercent); }
+    bool isClosed() const { return position() == 0; }
+    bool isOpen() const { return position() == 100; }
+    
+    void setVehiclePresent(bool present) { vehicle = present; }
+    bool vehiclePresent() const { return vehicle; }
+    
+private:
+    uint8_t slaveId;
+    double percentPerMs;
+    double positionPercent = 0;
+    bool openCommand = false;
+    Clock::time_point lastUpdate;
+    bool started = false;
+    atomic<bool> vehicle{false};
+    
+    bool discreteInput(uint16_t address) const;
+    size_t exception(uint8_t function, uint8_t code, uint8_t* reply) const;
+};
+
+#endif /* BarrierModel_hpp */
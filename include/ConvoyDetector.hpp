@@ -0,0 +1,57 @@
+//
+//  ConvoyDetector.hpp
+//  Parking
+//
+
+#ifndef ConvoyDetector_hpp
+#define ConvoyDetector_hpp
+
+#include <stdio.h>
+#include <deque>
+#include <chrono>
+
+using namespace std;
+
+struct ConvoySettings {
+    double enterPerMinute = 0;      // Разрешений в минуту, с которых полоса - колонна. 0 - режим выключен
+    double exitPerMinute = 0;       // Ниже - обычный режим (меньше enter, чтобы не дребезжало)
+    chrono::milliseconds window{60000};  // Окно подсчета разрешений
+    chrono::milliseconds hold{10000};    // В колонне держим открытым столько после последней машины
+    // Опрос датчика проезда в колонне: проезд только перезапускает hold, точность не нужна.
+    // 0 - как обычно (vehiclePoll)
+    chrono::milliseconds vehiclePoll{0};
+
+    bool enabled() const { return enterPerMinute > 0; }
+};
+
+// Колонна: разрешенные машины идут чаще порога. Тогда шлагбаум между ними не закрываем -
+// каждое закрытие/открытие это механический цикл и команды на шине, а следующая машина
+// уже подъезжает. Темп - число разрешений за окно, вход и выход с гистерезисом.
+// Без своей блокировки - владелец зовет под своей
+class ConvoyDetector {
+public:
+    using Clock = chrono::steady_clock;
+
+    ConvoyDetector() = default;
+    explicit ConvoyDetector(const ConvoySettings& convoySettings) : config(convoySettings) {}
+
+    void configure(const ConvoySettings& convoySettings);
+    const ConvoySettings& settings() const { return config; }
+
+    // Разрешили проезд. true - режим сменился
+    bool arrival(Clock::time_point now);
+    // Окно сдвинулось без новых машин. true - режим сменился
+    bool update(Clock::time_point now);
+
+    bool active() const { return convoy; }
+    double ratePerMinute() const;
+
+private:
+    ConvoySettings config;
+    deque<Clock::time_point> arrivals;
+    bool convoy = false;
+
+    void trim(Clock::time_point now);
+};
+
+#endif /* ConvoyDetector_hpp */
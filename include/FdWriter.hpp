@@ -0,0 +1,26 @@
+//
+//  FdWriter.hpp
+//  Parking
+//
+
+#ifndef FdWriter_hpp
+#define FdWriter_hpp
+
+#include <stdio.h>
+#include <chrono>
+#include "ICommunication.h"
+
+using namespace std;
+
+// Запись кусков в неблокирующий fd (порт или сокет) одним writev/sendmsg.
+// Недописанный хвост дописывается, на EAGAIN ждем готовности через poll - все до одного дедлайна
+namespace FdWriter {
+    // Кусков за один системный вызов, остальные - следующими
+    constexpr int maxPartsPerCall = 16;
+
+    // socket - писать через sendmsg(MSG_NOSIGNAL), чтобы разрыв соединения не убил процесс SIGPIPE.
+    // false - не успели до дедлайна или ошибка записи
+    bool writeParts(int fd, const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline, bool socket);
+}
+
+#endif /* FdWriter_hpp */
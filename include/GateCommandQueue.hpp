@@ -0,0 +1,173 @@
+//
+//  GateCommandQueue.hpp
+//  Parking
+//
+
+#ifndef GateCommandQueue_hpp
+#define GateCommandQueue_hpp
+
+#include <stdio.h>
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <condition_variable>
+#include <chrono>
+#include "GateController.hpp"
+#include "TimerWheel.hpp"
+#include "ConvoyDetector.hpp"
+
+using namespace std;
+
+enum class GateCommand {
+    Open,
+    Close
+};
+
+enum class GateCommandOutcome {
+    Done,       // Дошел до концевика
+    Failed,     // Отказ slave, нет ответа или не доехал (фаза - в phase)
+    Coalesced,  // Шлагбаум уже там или едет туда - на шину не ходили
+    Rejected,   // Очередь полна (HTTP 429)
+    Cancelled   // Очередь остановили, команду не выполняли
+};
+
+const char* gateCommandName(GateCommand command);
+const char* gateCommandOutcomeName(GateCommandOutcome outcome);
+
+struct GateCommandResult {
+    GateCommand command = GateCommand::Open;
+    GateCommandOutcome outcome = GateCommandOutcome::Done;
+    GatePhase phase = GatePhase::Unknown;   // Фаза после выполнения
+    string error;
+    chrono::milliseconds queued{0};         // Сколько ждала в очереди
+    chrono::milliseconds elapsed{0};        // Сколько выполнялась
+
+    bool ok() const { return outcome == GateCommandOutcome::Done || outcome == GateCommandOutcome::Coalesced; }
+};
+
+struct GateCommandStats {
+    uint64_t executed = 0;   // Ушли на шину
+    uint64_t coalesced = 0;  // Присоединились к такой же команде или шлагбаум уже там
+    uint64_t rejected = 0;
+    uint64_t failed = 0;
+    size_t maxDepth = 0;
+    uint64_t autoCloses = 0;        // Закрыли по таймеру
+    uint64_t autoCloseExtended = 0; // Новый проезд продлил таймер, а не поставил второй
+    uint64_t vehicleCloses = 0;     // Из них закрыли по датчику проезда, а не по времени
+    uint64_t closeDeferred = 0;     // Таймер вышел, а в створе машина - отложили
+    uint64_t convoyActivations = 0; // Сколько раз полоса переходила в режим колонны
+    uint64_t convoyArrivals = 0;    // Разрешений, пришедших в режиме колонны
+    uint64_t superseded = 0;        // Встречных команд снято групповой командой
+};
+
+// Очередь команд одного шлагбаума и один поток, который их выполняет.
+// Вместо потока на каждый /open: сколько бы ни пришло запросов, на шину команды идут по одной,
+// одинаковые подряд склеиваются (open во время открытия - это то же открытие), а когда очередь
+// полна - сразу отказ, и вызывающий отвечает 429, а не копит потоки.
+// Результат - настоящий исход (концевик или фаза сбоя), в колбэке или future.
+// Автозакрытие - один таймер на шлагбаум: открытие с autoClose ставит его или продлевает,
+// закрытие (любое) снимает. Срабатывание - обычная команда Close в эту же очередь,
+// но в запасное место: полная очередь его не отклоняет.
+// С датчиком проезда таймер - запасной: машина освободила створ - закрываем через clearDelay,
+// пока машина в створе - не закрываем вовсе.
+// Колонна (разрешения чаще порога): держим открытым convoy.hold после последней машины,
+// а не закрываем за каждой - новые разрешения только продлевают таймер, на шину не идут
+class GateCommandQueue {
+public:
+    using Completion = function<void(const GateCommandResult& result)>;
+
+    GateCommandQueue(GateController& gateController, size_t maxDepth = 4);
+    ~GateCommandQueue();
+
+    // Глубина - до start()
+    void setMaxDepth(size_t depth) { maxDepth = depth; }
+    // Таймеры автозакрытия и сколько держать открытым после последнего открытия с autoClose
+    void setAutoClose(TimerWheel& wheel, chrono::milliseconds holdOpen);
+    // Закрывать через afterClear после того, как машина освободила датчик. До start()
+    void setVehicleClose(chrono::milliseconds afterClear);
+    // Режим колонны по темпу разрешений (открытий с autoClose). До start()
+    void setConvoy(const ConvoySettings& settings);
+    bool convoyActive() const;
+    void start();
+    void stop();
+
+    // Поставить команду. done вызывается один раз: в потоке очереди после выполнения,
+    // или сразу в вызывающем потоке, если склеили с состоянием шлагбаума или отказали.
+    // autoClose - после открытия поставить или продлить автозакрытие (RFID).
+    // false - очередь полна или остановлена (done уже вызван с Rejected)
+    bool submit(GateCommand command, Completion done, bool autoClose = false);
+    future<GateCommandResult> submitAsync(GateCommand command, bool autoClose = false);
+    // Команда ушла мимо очереди (группа): снимаем автозакрытие и встречные команды
+    // (их waiters получают Cancelled), одинаковые оставляем, но без автозакрытия -
+    // иначе таймер RFID или ждущий /open отменили бы групповую команду
+    void supersede(GateCommand command);
+
+    size_t depth() const;
+    GateCommandStats stats() const;
+    bool autoClosePending() const;
+
+private:
+    struct Pending {
+        GateCommand command;
+        bool autoClose = false;
+        chrono::steady_clock::time_point queuedAt;
+        vector<Completion> waiters;
+    };
+
+    GateController& controller;
+    size_t maxDepth;
+
+    mutable mutex queueMutex;
+    condition_variable wake;
+    deque<Pending> pending;
+    // Выполняемая сейчас: к ней тоже можно присоединиться
+    Pending active;
+    bool busy = false;
+    GateCommandStats counters;
+
+    thread worker;
+    atomic<bool> running{false};
+
+    // Автозакрытие. Поколение отличает наш таймер от уже снятого, но успевшего сработать
+    mutable mutex autoCloseMutex;
+    TimerWheel* timers = nullptr;
+    chrono::milliseconds holdOpen{0};
+    TimerWheel::TimerId autoCloseTimer = 0;
+    uint64_t autoCloseGeneration = 0;
+    atomic<uint64_t> autoCloses{0};
+    atomic<uint64_t> autoCloseExtended{0};
+
+    // Датчик проезда
+    chrono::milliseconds clearDelay{0};
+    bool vehicleInLane = false;
+    bool closeOnClear = false;  // Таймер переставлен проездом
+    atomic<uint64_t> vehicleCloses{0};
+    atomic<uint64_t> closeDeferred{0};
+
+    ConvoyDetector convoy;
+    chrono::milliseconds normalVehiclePoll{0};
+    atomic<uint64_t> convoyActivations{0};
+    atomic<uint64_t> convoyArrivals{0};
+
+    // Под autoCloseMutex
+    chrono::milliseconds currentHold() const;
+    void convoyChanged();
+
+    void noteArrival();
+    void armAutoClose();
+    void cancelAutoClose();
+    void fireAutoClose(uint64_t generation);
+    void vehicleChanged(bool present);
+
+    // submit; reserved - место сверх maxDepth (автозакрытие: его таймер уже снят, отказ потерял бы закрытие)
+    bool enqueue(GateCommand command, Completion done, bool autoClose, bool reserved);
+    void workerLoop();
+    GateCommandResult execute(const Pending& job);
+    static void complete(vector<Completion>& waiters, const GateCommandResult& result);
+};
+
+#endif /* GateCommandQueue_hpp */
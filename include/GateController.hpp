@@ -11,19 +11,102 @@
 #include <stdio.h>
 #include "SerialPort.hpp"
 #include "ICommunication.h"
+#include "ModbusUtils.hpp"
+#include "ModbusFramer.hpp"
+#include "ModbusException.hpp"
+#include "GateStateMachine.hpp"
 #include <unistd.h>
 #include <functional>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 
+// Полное состояние шлагбаума за один опрос
+struct GateState {
+    bool valid = false;    // Удалось ли прочитать
+    bool isClosed = false; // DI1 - концевик закрытия
+    bool isOpen = false;   // DI2 - концевик открытия
+    int position = -1;     // IR0 - положение стрелы, %
+    bool vehiclePresent = false; // Датчик проезда (петля/фотоэлемент), если подключен
+    uint8_t exceptionCode = 0; // Код исключения Modbus, если slave отказал (0 - нет)
+    chrono::steady_clock::time_point timestamp;
+};
+
+// Как ушла команда
+enum class CommandDelivery {
+    Echoed,  // Эхо получено
+    NoEcho,  // Запрос был на линии, эха нет (команда могла выполниться)
+    NotSent  // На линию не ушел (очередь шины, ошибка записи) - slave ее не видел
+};
+
 class GateController {
     using LogCallback = function<void(string type, string message)>;
+public:
+    // Часы и пауза между опросами в waitForOpen/waitForClose
+    using NowFunction = function<chrono::steady_clock::time_point()>;
+    using SleepFunction = function<void(chrono::milliseconds)>;
 private:
     ICommunication& port;
     LogCallback logger;
     uint8_t deviceId;
+    
+    // Ответы разбирает фреймер, свой на каждый обмен - общего состояния между потоками нет,
+    // очередь на шину держит port.transact. Здесь только счетчики
+    int baudRate = 9600;
+    atomic<size_t> garbageBytes{0};
+    atomic<size_t> staleFrames{0};
+    
+    // Окно ожидания ответа. 9600 бод: запрос 8 байт + ответ до 9 байт ~ 18 мс на линии,
+    // остальное - запас на обработку в slave
+    int replyTimeoutMs = 50;
+    
+    // По умолчанию настоящие, в симуляции линии - виртуальные
+    NowFunction clockNow = []() { return chrono::steady_clock::now(); };
+    SleepFunction sleepFor = [](chrono::milliseconds duration) { this_thread::sleep_for(duration); };
+    
+    // Фаза и расписание опросов. Все опросы состояния проходят через него
+    GateStateMachine stateMachine;
+    
+    // Концевики (и датчик проезда, если он есть) одним запросом: DI1..DI(count)
+    ModbusFrame::Buffer limitsRequest;
+    int vehicleInput = 0;
+    
+    // Опрос концевиков и (если withPosition) положения, без учета в автомате
+    GateState queryState(bool withPosition = true);
+    // Опрашиваем по расписанию автомата, пока не придем в target/Fault или не выйдет deadline
+    void pollUntil(GatePhase target, chrono::steady_clock::time_point deadline);
+    
+    // Отправляет готовый кадр и ждет ответ на него. Возвращает длину ответа,
+    // noReply (запрос ушел, ответа нет) или notSent (на линию не ушел)
+    static constexpr int noReply = -1;
+    static constexpr int notSent = -2;
+    int transaction(const ModbusFrame::Buffer& request, uint8_t* reply, size_t capacity, int timeoutMs);
+    // Ответ - исключение Modbus? Тогда сразу ModbusException
+    void throwIfException(const uint8_t* reply, int length);
 public:
-    GateController(ICommunication& channel, uint8_t id) : port(channel), deviceId(id) {}
+    GateController(ICommunication& channel, uint8_t id) : port(channel), deviceId(id), limitsRequest(ReadLimitsFrame::forSlave(id)) {}
+    
+    void setClock(NowFunction now, SleepFunction sleep) {
+        clockNow = move(now);
+        sleepFor = move(sleep);
+    }
+    
+    void setReplyTimeout(int timeoutMs) {
+        replyTimeoutMs = timeoutMs;
+    }
+    
+    // Пауза между кадрами (t3.5) зависит от скорости линии
+    void setBaudRate(int rate) {
+        baudRate = rate;
+    }
+    
+    // Датчик проезда на DI3..DI8 - читается тем же запросом, что и концевики, обмен не добавляет.
+    // 0 - датчика нет. До начала опросов
+    void setVehicleSensor(int discreteInput);
+    int vehicleSensor() const { return vehicleInput; }
     
     void setLogger(LogCallback cb) {
         logger = cb;
@@ -35,12 +118,46 @@ public:
         }
     }
     
-    void openGate(bool autoClose = false);
-    void waitForOpen();
+    // Строки собираем только если логгер подключен (без лишних аллокаций на горячем пути)
+    void log(const char* type, const char* msg) {
+        if (logger) {
+            logger(type, msg);
+        }
+    }
+    
+    // Команды и опросы бросают ModbusException, если slave отказал.
+    // Автозакрытие - не здесь, а в GateCommandQueue (таймер, который можно продлить)
+    void openGate();
+    // Только команда, без ожидания концевика: эхо от slave - и в автомат фаз.
+    // Без эха автомат не трогаем, вызывающий решает сам: NoEcho - команда была на линии,
+    // NotSent - не была
+    CommandDelivery sendCommand(bool open);
+    // Команда ушла не через этот контроллер (broadcast группы) - автомат ждет движения
+    void markCommandSent(bool open) { stateMachine.commandSent(open, clockNow()); }
+    // Ждут концевика не дольше travelTimeout автомата. false - не доехал (Fault или таймаут)
+    bool waitForOpen();
     bool isGateOpen();
     void closeGate();
-    void waitForClose();
+    bool waitForClose();
     bool isGateClose();
+    // Ждать фазы target (или Fault). Опрашивает один из ждущих, остальные ждут смены фазы.
+    // Возвращает фазу, в которой закончили ждать
+    GatePhase waitForPhase(GatePhase target, chrono::milliseconds timeout);
     int  getGatePosition();
+    // Концевики и положение за две транзакции вместо трех. Не бросает, отказ - в exceptionCode.
+    // Результат учитывается в автомате фаз
+    GateState readState();
+    
+    // Один опрос по плану автомата (концевики и/или положение), результат - в автомат.
+    // Не бросает. position = -1, если положение не читали
+    GateState poll(const GatePollPlan& plan);
+    
+    uint8_t slaveId() const { return deviceId; }
+    GateStateMachine& states() { return stateMachine; }
+    GatePhase phase() const { return stateMachine.phase(); }
+    
+    // Статистика канала
+    size_t garbageBytesCount() const { return garbageBytes; }
+    size_t staleFramesCount() const { return staleFrames; }
 };
 #endif /* GateController_hpp */
@@ -0,0 +1,93 @@
+//
+//  GateGroup.hpp
+//  Parking
+//
+
+#ifndef GateGroup_hpp
+#define GateGroup_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include "GateController.hpp"
+#include "GateCommandQueue.hpp"
+
+using namespace std;
+
+// Исход групповой команды
+struct GateGroupResult {
+    GateCommand command = GateCommand::Open;
+    bool ok = false;          // Все дошли до концевика
+    bool broadcast = false;   // Ушла одним кадром на адрес 0
+    size_t members = 0;
+    size_t reached = 0;       // Сколько дошли
+    vector<GatePhase> phases; // Фазы участников после ожидания, в порядке группы
+    string error;
+    chrono::milliseconds elapsed{0};
+};
+
+// Группа шлагбаумов на одной линии (въезд + выезд, банк полос, эвакуация).
+// Broadcast (Write Multiple Coils 0x0F на адрес 0) слышат все slave линии, поэтому одним кадром
+// командуем, только если группа - ровно все slave этой линии и ни у кого нет ID 0
+// (такой slave отвечает на 0 как на свой адрес). Иначе - команда каждому по его адресу.
+// Все обмены - транзакциями портов (очередь шины), автомат фаз каждого участника знает о команде,
+// дальше ждем концевики через waitForPhase с общим дедлайном.
+class GateGroup {
+public:
+    using Completion = function<void(const GateGroupResult& result)>;
+
+    // port - линия для broadcast, busSlaves - адреса всех slave на ней (вместе с участниками)
+    GateGroup(ICommunication& port, vector<GateController*> members, vector<uint8_t> busSlaves, int turnaroundMs = 50);
+    ~GateGroup();
+
+    // Открыть/закрыть всех и дождаться. false - кто-то не дошел до концевика за timeoutMs
+    bool openAll(int timeoutMs = 10000);
+    bool closeAll(int timeoutMs = 10000);
+
+    // Очередь команд участника (если у него есть своя): групповая команда идет мимо нее,
+    // поэтому перед отправкой снимает ее автозакрытие и встречные команды. До start()
+    void addQueue(GateCommandQueue& queue) { queues.push_back(&queue); }
+
+    // Только команда, без ожидания. false - кому-то не ушла (остальным ушла)
+    bool commandAll(bool open);
+    // Ждем всех по очереди до одного дедлайна: пока ждем первого, остальные едут
+    bool waitForAll(bool open, int timeoutMs);
+
+    // Команда broadcast или по адресам
+    bool usesBroadcast() const { return broadcastable; }
+    size_t size() const { return members.size(); }
+    vector<GateState> states();
+
+    // Команда с ожиданием в своем потоке, чтобы не держать вызывающего (HTTP, RFID).
+    // Одна за раз: пока предыдущая выполняется, новая получает false
+    void start(int timeoutMs = 10000);
+    void stop();
+    bool submit(GateCommand command, Completion done);
+
+private:
+    ICommunication& port;
+    vector<GateController*> members;
+    vector<GateCommandQueue*> queues;
+    bool broadcastable = false;
+    int turnaroundMs;
+
+    thread worker;
+    atomic<bool> running{false};
+    mutex jobMutex;
+    condition_variable wake;
+    bool pending = false;
+    bool busy = false;
+    GateCommand nextCommand = GateCommand::Open;
+    Completion nextDone;
+    int commandTimeoutMs = 10000;
+
+    GateGroupResult execute(GateCommand command, int timeoutMs);
+    void workerLoop();
+};
+
+#endif /* GateGroup_hpp */
@@ -0,0 +1,78 @@
+//
+//  GateStateCache.hpp
+//  Parking
+//
+
+#ifndef GateStateCache_hpp
+#define GateStateCache_hpp
+
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "GateController.hpp"
+#include "Seqlock.hpp"
+
+using namespace std;
+
+// Что известно о шлагбауме на момент последнего удачного опроса
+struct GateSnapshot {
+    GateState state;        // Концевики - по фазе, положение - последнее прочитанное
+    GatePhase phase = GatePhase::Unknown;
+    double speed = 0;       // %/с, + к открытию
+    chrono::steady_clock::time_point updatedAt;
+    uint64_t polls = 0;     // Сколько опросов было к этому снимку, 0 - еще ни одного
+    bool vehicleSensor = false;  // Есть датчик проезда - state.vehiclePresent имеет смысл
+
+    chrono::milliseconds age(chrono::steady_clock::time_point now = chrono::steady_clock::now()) const {
+        return chrono::duration_cast<chrono::milliseconds>(now - updatedAt);
+    }
+};
+
+// Единственный, кто опрашивает шлагбаум: поток-опросчик по расписанию автомата фаз
+// (часто в движении, раз в idlePoll в покое). Остальные - /status, websocket, ждущие команд -
+// читают снимок без блокировок и без шины, поэтому число обменов не зависит от числа клиентов.
+// Смена фазы (команда открыть/закрыть) будит опросчик сразу
+class GateStateCache {
+public:
+    explicit GateStateCache(GateController& gateController);
+    ~GateStateCache();
+
+    void start();
+    void stop();
+    bool isRunning() const { return running; }
+
+    // Последний снимок: без блокировок, микросекунды
+    GateSnapshot snapshot() const { return published.load(); }
+    // Снимок не старше maxAge: если старее - просим опрос и ждем его не дольше wait.
+    // Не для потока событий (uWS, reactor) - там snapshot() + requestRefresh()
+    GateSnapshot freshSnapshot(chrono::milliseconds maxAge, chrono::milliseconds wait);
+    // Попросить внеочередной опрос, не дожидаясь его
+    void requestRefresh();
+
+    // Один опрос и публикация. Делает опросчик; без него (симуляция, тесты) можно звать руками.
+    // Возвращает план следующего опроса
+    GatePollPlan pollOnce(const GatePollPlan& plan);
+
+    uint64_t pollCount() const { return polls; }
+
+private:
+    GateController& controller;
+    Seqlock<GateSnapshot> published;
+    // Пишет только опрашивающий
+    GateSnapshot latest;
+    atomic<uint64_t> polls{0};
+
+    thread poller;
+    atomic<bool> running{false};
+    mutex signalMutex;
+    condition_variable pollerWake;      // Опросчику: пора (команда, запрос свежести, stop)
+    condition_variable snapshotReady;   // Ждущим свежего снимка
+    bool refreshRequested = false;
+
+    void pollLoop();
+};
+
+#endif /* GateStateCache_hpp */
@@ -0,0 +1,139 @@
+//
+//  GateStateMachine.hpp
+//  Parking
+//
+
+#ifndef GateStateMachine_hpp
+#define GateStateMachine_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+struct GateState;
+
+// Фаза шлагбаума. Концевики говорят только про крайние положения,
+// движение и сбой - вывод из команд, положения стрелы и времени
+enum class GatePhase {
+    Unknown,    // Еще не опрашивали
+    Closed,
+    Opening,
+    Open,
+    Closing,
+    Fault       // Оба концевика, отказ slave, нет ответа или не доехал за travelTimeout
+};
+
+const char* gatePhaseName(GatePhase phase);
+
+// Что и когда опрашивать дальше
+struct GatePollPlan {
+    chrono::milliseconds delay;   // Пауза до следующего опроса
+    bool readLimits;              // Концевики
+    bool readPosition;            // Положение стрелы
+};
+
+// Снимок для /status и логов
+struct GateMotion {
+    GatePhase phase = GatePhase::Unknown;
+    int position = -1;
+    double speed = 0;               // %/с, знак - направление (+ к открытию)
+    chrono::steady_clock::time_point phaseSince;
+    uint64_t transitions = 0;
+    bool vehiclePresent = false;    // Датчик проезда (если есть)
+};
+
+// Конечный автомат шлагбаума и расписание опросов.
+// В движении скорость стрелы оценивается по положению, и опросы сгущаются к расчетному моменту
+// прихода на концевик: сразу после команды - часто, в середине хода - редко, у концевика - снова часто.
+// В покое - раз в idlePoll, открытый с датчиком проезда - раз в vehiclePoll, чтобы поймать проезд.
+// Опрашивает один поток (beginPolling), остальные ждут смены фазы
+class GateStateMachine {
+public:
+    using Clock = chrono::steady_clock;
+    // Вызывается после смены фазы, вне блокировки автомата, в потоке того, кто ее вызвал
+    using Listener = function<void(GatePhase phase)>;
+    // То же для датчика проезда: true - машина заехала в створ, false - освободила
+    using VehicleListener = function<void(bool present)>;
+
+    struct Timing {
+        chrono::milliseconds fastPoll{20};          // После команды и у концевика
+        chrono::milliseconds slowPoll{500};         // Самая длинная пауза в движении
+        chrono::milliseconds idlePoll{1000};        // Стоит на концевике
+        chrono::milliseconds travelTimeout{10000};  // Не доехал - Fault
+        int maxFailedPolls = 5;                     // Подряд без ответа - Fault
+        chrono::milliseconds vehiclePoll{100};      // Открыт и есть датчик проезда
+    };
+
+    GateStateMachine() = default;
+    explicit GateStateMachine(const Timing& pollTiming) : schedule(pollTiming) {}
+
+    void setTiming(const Timing& pollTiming);
+    Timing timing() const;
+    // До начала работы (список не защищен)
+    void addListener(Listener listener) { listeners.push_back(move(listener)); }
+    void addVehicleListener(VehicleListener listener) { vehicleListeners.push_back(move(listener)); }
+    // Есть ли датчик проезда: тогда открытый шлагбаум опрашиваем часто
+    void setVehicleSensor(bool enabled);
+
+    // Команда принята шлагбаумом
+    void commandSent(bool open, Clock::time_point now);
+    // Опрос концевиков (position = -1, если положение не читали). true - фаза сменилась
+    bool observe(const GateState& state, Clock::time_point now);
+    // Опрос только положения стрелы. position < 0 - не прочитали
+    bool observePosition(int position, Clock::time_point now);
+
+    GatePollPlan nextPoll(Clock::time_point now) const;
+
+    GatePhase phase() const;
+    GateMotion motion() const;
+    bool isMoving() const;
+
+    // Опрашивает только один поток: true - теперь мы, false - уже кто-то
+    bool beginPolling();
+    void endPolling();
+    bool isPolling() const;
+    // Ждать смены фазы после seenTransitions или пока опрашивающий не освободится (реальные часы)
+    void waitForChange(uint64_t seenTransitions, Clock::time_point deadline);
+
+private:
+    mutable mutex stateMutex;
+    condition_variable changed;
+    Timing schedule;
+
+    GatePhase current = GatePhase::Unknown;
+    Clock::time_point phaseSince;
+    uint64_t transitions = 0;
+    bool polling = false;
+
+    // Движение: откуда и когда поехали, оценка скорости
+    Clock::time_point commandAt;
+    int startPosition = -1;
+    Clock::time_point startAt;
+    int position = -1;
+    double speedPerMs = 0;
+    int failedPolls = 0;
+
+    bool vehicleSensor = false;
+    bool vehiclePresent = false;
+
+    vector<Listener> listeners;
+    vector<VehicleListener> vehicleListeners;
+
+    // Под stateMutex
+    bool applyCommand(bool open, Clock::time_point now);
+    bool applyObservation(const GateState& state, Clock::time_point now);
+    // true - датчик проезда сменился
+    bool applyVehicle(const GateState& state);
+    bool applyPosition(int value, Clock::time_point now);
+    bool moveTo(GatePhase next, Clock::time_point now);
+    bool checkTravelTimeout(Clock::time_point now);
+    void trackPosition(int value, Clock::time_point now);
+};
+
+#endif /* GateStateMachine_hpp */
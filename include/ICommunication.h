@@ -8,17 +8,245 @@
 #ifndef ICommunication_h
 #define ICommunication_h
 
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+
 using namespace std;
 
+/// Кусок кадра для отправки без склейки (как iovec): заголовок, PDU, CRC из разных буферов
+struct ByteSpan {
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+};
+
+/// Как собрать ответ в transact: получает очередную порцию байт и время ее прихода
+/// (для паузы t3.5 во фреймере), true - ответ собран.
+/// Указатель на функцию + контекст, чтобы не аллоцировать std::function на каждый обмен
+struct ReplySpec {
+    bool (*consume)(void* context, const uint8_t* data, size_t length, chrono::steady_clock::time_point arrivedAt) = nullptr;
+    void* context = nullptr;
+    
+    /// Из лямбды/функтора bool(const uint8_t*, size_t, time_point). Он должен жить до конца transact
+    template <typename F>
+    static ReplySpec from(F& handler) {
+        ReplySpec spec;
+        spec.consume = [](void* context, const uint8_t* data, size_t length, chrono::steady_clock::time_point arrivedAt) {
+            return (*static_cast<F*>(context))(data, length, arrivedAt);
+        };
+        spec.context = &handler;
+        return spec;
+    }
+};
+
+/// Исход transact. Не ушел и нет ответа - разные вещи: команду, которая не ушла,
+/// устройство не видело, а без ответа она могла выполниться
+enum class TransactResult {
+    Replied,  // Ответ собран
+    NoReply,  // Запрос на линии, ответ не собрался до дедлайна
+    NotSent   // На линию не ушел: дедлайн вышел в очереди или ошибка записи
+};
+
+/// Занятость шины: сколько обменов и сколько они ждали своей очереди
+struct BusStats {
+    uint64_t transactions = 0;
+    uint64_t timeouts = 0;        // Ответ не собрался до дедлайна
+    uint64_t staleBytes = 0;      // Выброшено до отправки (хвосты чужих ответов)
+    uint64_t totalQueueWaitUs = 0;
+    uint64_t maxQueueWaitUs = 0;
+    
+    uint64_t averageQueueWaitUs() const {
+        return transactions ? totalQueueWaitUs / transactions : 0;
+    }
+};
+
 class ICommunication {
+private:
+    // Билетная очередь на шину: кто раньше пришел, тот раньше обменивается
+    mutex busMutex;
+    condition_variable busTurn;
+    uint64_t nextTicket = 0;
+    uint64_t nowServing = 0;
+    BusStats stats;
+protected:
+    /// Очередь шины на время одного обмена: конструктор ждет своей очереди,
+    /// деструктор (даже при исключении) пропускает следующего
+    class BusTurn {
+        ICommunication& bus;
+    public:
+        bool done = false;
+        uint64_t staleBytes = 0;
+        
+        explicit BusTurn(ICommunication& owner) : bus(owner) {
+            auto queuedAt = chrono::steady_clock::now();
+            unique_lock<mutex> lock(bus.busMutex);
+            uint64_t ticket = bus.nextTicket++;
+            bus.busTurn.wait(lock, [&]() { return bus.nowServing == ticket; });
+            
+            uint64_t waitUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - queuedAt).count();
+            bus.stats.transactions++;
+            bus.stats.totalQueueWaitUs += waitUs;
+            bus.stats.maxQueueWaitUs = max(bus.stats.maxQueueWaitUs, waitUs);
+        }
+        
+        ~BusTurn() {
+            bool queued;
+            {
+                lock_guard<mutex> lock(bus.busMutex);
+                bus.stats.staleBytes += staleBytes;
+                if (!done) bus.stats.timeouts++;
+                bus.nowServing++;
+                queued = bus.nextTicket != bus.nowServing;
+            }
+            // Будим только если кто-то стоит в очереди
+            if (queued) bus.busTurn.notify_all();
+        }
+    };
 public:
     virtual ~ICommunication() = default;
     virtual bool connect(const string& address) = 0;
     virtual void disconnect() = 0;
-    virtual bool sendBytes(const vector<uint8_t>& data) = 0;
-    virtual int readBytes(vector<uint8_t>& buffer, int exprected, int timeout) = 0;
+    /// Отправка из буфера вызывающего, без промежуточных копий
+    virtual bool sendBytes(const uint8_t* data, size_t length) = 0;
+    /// Отправка не позже deadline. По умолчанию - проверка перед отправкой, порты с неблокирующей
+    /// записью ждут готовности не дольше дедлайна
+    virtual bool sendBytesUntil(const uint8_t* data, size_t length, chrono::steady_clock::time_point deadline) {
+        if (chrono::steady_clock::now() >= deadline) return false;
+        return sendBytes(data, length);
+    }
+    /// Отправка кусков подряд как одного кадра, deadline - на всю отправку.
+    /// По умолчанию склеивает на стеке и отдает в sendBytesUntil; порт и сокеты пишут через writev.
+    /// Кадр больше буфера не режем (пауза между кусками - разрыв RTU кадра), а отказываем
+    virtual bool sendParts(const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline) {
+        uint8_t frame[512];
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (total + parts[i].length > sizeof(frame)) {
+                return false;
+            }
+            copy_n(parts[i].data, parts[i].length, frame + total);
+            total += parts[i].length;
+        }
+        return sendBytesUntil(frame, total, deadline);
+    }
+    /// Чтение того что уже пришло (до capacity байт), ждем первый байт не дольше timeoutMs.
+    /// 0 - ничего не пришло, -1 - ошибка
+    virtual int readAvailable(uint8_t* buffer, int capacity, int timeoutMs) = 0;
+    /// То же, плюс когда порция пришла. Порт с фоновым приемом знает это точнее, чем момент чтения:
+    /// байты могли пролежать в кольце, пока читатель спал. По умолчанию - момент чтения
+    virtual int readChunk(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt) {
+        int n = readAvailable(buffer, capacity, timeoutMs);
+        arrivedAt = chrono::steady_clock::now();
+        return n;
+    }
+    
+    /// Чтение expected байт с одним дедлайном на весь кадр (монотонные часы).
+    /// Сколько бы кусками ни приходил ответ, дольше deadline не ждем
+    virtual int readBytesUntil(uint8_t* buffer, int expected, chrono::steady_clock::time_point deadline) {
+        int total = 0;
+        
+        while (total < expected) {
+            auto remaining = chrono::ceil<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            if (remaining <= 0) break;
+            
+            int n = readAvailable(buffer + total, expected - total, static_cast<int>(remaining));
+            if (n < 0) return total > 0 ? total : -1;
+            total += n;
+        }
+        return total;
+    }
+    
+    /// Чтение в буфер вызывающего (не меньше expected байт), таймаут в секундах
+    virtual int readBytes(uint8_t* buffer, int expected, int timeout) {
+        return readBytesUntil(buffer, expected, chrono::steady_clock::now() + chrono::seconds(timeout));
+    }
     /// Очистка канала
     virtual void flush() = 0;
+    /// Паузы между пришедшими порциями - это паузы на линии RS-485 (по ним фреймер ищет t3.5).
+    /// У TCP шлюза порции режет сеть, пауза внутри кадра там не разрыв
+    virtual bool hasLineTiming() const { return true; }
+    
+    /// Запрос и ответ одной операцией: шина занята от отправки до собранного ответа (или deadline),
+    /// остальные ждут по очереди. Все что лежало в канале до отправки - не наше, выбрасываем
+    virtual TransactResult transact(const uint8_t* request, size_t length, ReplySpec reply, chrono::steady_clock::time_point deadline) {
+        BusTurn turn(*this);
+        
+        // Пока стояли в очереди, дедлайн мог истечь - тогда не шлем вовсе,
+        // иначе ответ достанется следующему в очереди как мусор
+        if (chrono::steady_clock::now() >= deadline) return TransactResult::NotSent;
+        
+        uint8_t chunk[64];
+        int n;
+        while ((n = readAvailable(chunk, sizeof(chunk), 0)) > 0) {
+            turn.staleBytes += n;
+        }
+        
+        if (!sendBytes(request, length)) return TransactResult::NotSent;
+        
+        while (true) {
+            auto remaining = chrono::ceil<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            if (remaining <= 0) return TransactResult::NoReply;
+            
+            chrono::steady_clock::time_point arrivedAt;
+            n = readChunk(chunk, sizeof(chunk), static_cast<int>(remaining), arrivedAt);
+            if (n < 0) return TransactResult::NoReply;
+            if (n > 0 && reply.consume(reply.context, chunk, n, arrivedAt)) {
+                turn.done = true;
+                return TransactResult::Replied;
+            }
+        }
+    }
+    
+    /// Broadcast (адрес 0): ответа нет, поэтому шина занята еще turnaround после отправки -
+    /// slave выполняют команду и следующий запрос не должны получить раньше.
+    /// false - не отправили
+    virtual bool broadcast(const uint8_t* request, size_t length, chrono::milliseconds turnaround) {
+        BusTurn turn(*this);
+        
+        uint8_t chunk[64];
+        int n;
+        while ((n = readAvailable(chunk, sizeof(chunk), 0)) > 0) {
+            turn.staleBytes += n;
+        }
+        
+        if (!sendBytes(request, length)) return false;
+        this_thread::sleep_for(turnaround);
+        turn.done = true;
+        return true;
+    }
+    
+    BusStats busStats() {
+        lock_guard<mutex> lock(busMutex);
+        return stats;
+    }
+    
+    template <size_t N>
+    bool sendParts(const ByteSpan (&parts)[N], chrono::steady_clock::time_point deadline) {
+        return sendParts(parts, N, deadline);
+    }
+    
+    bool sendBytes(const vector<uint8_t>& data) {
+        return sendBytes(data.data(), data.size());
+    }
+    
+    template <size_t N>
+    bool sendBytes(const array<uint8_t, N>& data) {
+        return sendBytes(data.data(), N);
+    }
+    
+    int readBytes(vector<uint8_t>& buffer, int expected, int timeout) {
+        buffer.resize(expected);
+        int bytesRead = readBytes(buffer.data(), expected, timeout);
+        buffer.resize(bytesRead > 0 ? bytesRead : 0);
+        return bytesRead;
+    }
 };
 
 
@@ -0,0 +1,59 @@
+//
+//  LaneMetrics.hpp
+//  Parking
+//
+
+#ifndef LaneMetrics_hpp
+#define LaneMetrics_hpp
+
+#include <stdio.h>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+
+using namespace std;
+
+struct LaneStats {
+    uint64_t vehicles = 0;          // Проездов всего
+    uint64_t cycles = 0;            // Открыт -> закрыт всего
+    double vehiclesPerMinute = 0;   // За последнее окно
+    chrono::milliseconds averageCycle{0};  // От концевика открытия до концевика закрытия
+    double vehiclesPerCycle = 0;
+};
+
+// Пропускная способность полосы: проезды (датчик освободился) и циклы шлагбаума.
+// Проезды - за скользящее окно, чтобы в час пик было видно текущий темп, а не средний за сутки
+class LaneMetrics {
+public:
+    using Clock = chrono::steady_clock;
+
+    explicit LaneMetrics(chrono::seconds rateWindow = chrono::seconds(60)) : window(rateWindow) {}
+
+    void vehiclePassed(Clock::time_point now = Clock::now());
+    void gateOpened(Clock::time_point now = Clock::now());
+    void gateClosed(Clock::time_point now = Clock::now());
+
+    LaneStats stats(Clock::time_point now = Clock::now()) const;
+    void print(ostream& out, Clock::time_point now = Clock::now()) const;
+
+private:
+    chrono::seconds window;
+
+    mutable mutex metricsMutex;
+    mutable deque<Clock::time_point> passages;
+    Clock::time_point firstEvent;
+    bool started = false;
+
+    uint64_t vehicles = 0;
+    uint64_t cycles = 0;
+    uint64_t cycleVehicles = 0;
+    chrono::milliseconds cyclesTotal{0};
+    Clock::time_point openedAt;
+    bool open = false;
+
+    void touch(Clock::time_point now);
+};
+
+#endif /* LaneMetrics_hpp */
@@ -0,0 +1,68 @@
+//
+//  LatencyHistogram.hpp
+//  Parking
+//
+
+#ifndef LatencyHistogram_hpp
+#define LatencyHistogram_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+using namespace std;
+
+// Гистограмма задержек в мкс по степеням двойки: [0,1) [1,2) [2,4) ... [2^22, ∞).
+// Пишет один поток, читать можно из любого: счетчики атомарные, без блокировок
+class LatencyHistogram {
+public:
+    static constexpr size_t bucketCount = 24;
+
+    void record(uint64_t us) {
+        size_t index = 0;
+        while (index + 1 < bucketCount && (us >> index) != 0) index++;
+        buckets[index].fetch_add(1, memory_order_relaxed);
+        total.fetch_add(1, memory_order_relaxed);
+        if (us > maximum.load(memory_order_relaxed)) maximum.store(us, memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+    uint64_t maxUs() const { return maximum.load(memory_order_relaxed); }
+
+    // Верхняя граница корзины, в которую попал перцентиль p (0..100). Точность - до степени двойки
+    uint64_t percentileUs(double p) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(n * p / 100.0);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucketCount; i++) {
+            seen += buckets[i].load(memory_order_relaxed);
+            if (seen > rank) return i + 1 < bucketCount ? (1ull << i) : maxUs();
+        }
+        return maxUs();
+    }
+
+    // Одной строкой для лога: p50/p99/p99.9/max и непустые корзины
+    void print(ostream& out) const {
+        out << "n=" << count() << " p50<" << percentileUs(50) << " p99<" << percentileUs(99)
+            << " p99.9<" << percentileUs(99.9) << " max=" << maxUs() << " мкс |";
+        for (size_t i = 0; i < bucketCount; i++) {
+            uint64_t n = buckets[i].load(memory_order_relaxed);
+            if (n) out << " <" << (1ull << i) << ":" << n;
+        }
+    }
+
+    void reset() {
+        for (auto& bucket : buckets) bucket.store(0, memory_order_relaxed);
+        total.store(0, memory_order_relaxed);
+        maximum.store(0, memory_order_relaxed);
+    }
+
+private:
+    atomic<uint64_t> buckets[bucketCount] = {};
+    atomic<uint64_t> total{0};
+    atomic<uint64_t> maximum{0};
+};
+
+#endif /* LatencyHistogram_hpp */
@@ -0,0 +1,140 @@
+//
+//  ModbusBusMaster.hpp
+//  Parking
+//
+
+#ifndef ModbusBusMaster_hpp
+#define ModbusBusMaster_hpp
+
+#include <stdio.h>
+#include <map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "ICommunication.h"
+#include "ModbusFramer.hpp"
+#include "RealtimeThread.hpp"
+
+using namespace std;
+
+// Статистика по одному slave на шине
+struct SlaveStats {
+    uint64_t transactions = 0;   // Успешные обмены
+    uint64_t timeouts = 0;       // Нет ответа за replyTimeout
+    uint64_t sendErrors = 0;     // Не смогли записать в порт
+    uint64_t cancelled = 0;      // Бюджет очереди вышел - на линию не ушел
+    uint64_t totalLatencyUs = 0; // Сумма задержек (запрос -> ответ)
+    uint64_t maxLatencyUs = 0;
+    uint64_t maxQueueWaitUs = 0; // Сколько запрос простоял в очереди
+    
+    uint64_t averageLatencyUs() const {
+        return transactions ? totalLatencyUs / transactions : 0;
+    }
+};
+
+// Master для RS-485 шины с несколькими шлагбаумами (multi-drop).
+// Владеет одним портом, по очереди выполняет обмены от всех GateController.
+// Каждому slave выдается свой канал (ICommunication), поэтому GateController не меняется.
+// Команды (запись) идут вне очереди опросов, внутри каждой очереди slave обслуживаются по кругу.
+// Ожидание в очереди и ответ - разные бюджеты. Очередь ждет не дольше queueTimeout: не дождался -
+// запрос снимается и на линию уже не уйдет, иначе его ответ достался бы следующему как чужой.
+// Дедлайн вызывающего (transact канала) - окно на ответ, оно отсчитывается с выхода на линию:
+// команда за опросом соседа не должна проесть свое окно в очереди.
+// Адрес 0 на такой шине - broadcast: ответа не ждем, только даем slave время на обработку.
+class ModbusBusMaster {
+public:
+    enum class Lane {
+        Command, // Открыть/закрыть - приоритет
+        Poll     // Опрос состояния
+    };
+    
+    ModbusBusMaster(ICommunication& port, int baudRate = 9600, int replyTimeoutMs = 1000, int turnaroundMs = 50);
+    ~ModbusBusMaster();
+    
+    // Пауза между запросами (t3.5) от скорости линии, до start()
+    void setBaudRate(int baudRate) { framer.setBaudRate(baudRate); }
+    // Сколько запрос может ждать своей очереди (окно на ответ сюда не входит)
+    void setQueueTimeout(int timeoutMs) {
+        lock_guard<mutex> lock(queueMutex);
+        queueTimeoutMs = timeoutMs;
+    }
+    
+    // Канал для конкретного slave, передаем его в GateController
+    ICommunication& channel(uint8_t slaveId);
+    
+    // Приоритет/ядро рабочего потока шины, задается до start()
+    void setRealtime(const RealtimeSettings& settings) { realtime = settings; }
+    void start();
+    void stop();
+    
+    SlaveStats stats(uint8_t slaveId);
+    map<uint8_t, SlaveStats> allStats();
+    
+private:
+    class BusChannel;
+    
+    // Обмен, которого ждет вызывающий transact. Живет у него на стеке, поля - под queueMutex
+    struct Exchange {
+        ReplySpec reply;
+        bool started = false;   // Уже на линии - снимать поздно, ждем исход
+        bool finished = false;
+        TransactResult result = TransactResult::NotSent;
+    };
+    
+    struct Job {
+        uint8_t slaveId;
+        Lane lane;
+        uint8_t request[ModbusRtuFramer::maxFrameSize];
+        size_t length;
+        chrono::steady_clock::time_point enqueuedAt;
+        chrono::steady_clock::time_point startBy;   // Не вышел на линию до этого - снимаем
+        chrono::steady_clock::duration replyWindow{0}; // Ждем ответ столько с начала обмена
+        Exchange* exchange = nullptr;  // nullptr - ответ в inbox канала (sendBytes)
+        bool broadcast = false;        // Ответа нет, после отправки линия молчит turnaround
+        chrono::milliseconds turnaround{0};
+    };
+    
+    ICommunication& port;
+    ModbusRtuFramer framer;
+    int replyTimeoutMs;
+    int turnaroundMs;
+    int queueTimeoutMs = 1000;
+    
+    map<uint8_t, unique_ptr<BusChannel>> channels;
+    map<uint8_t, SlaveStats> slaveStats;
+    
+    // Очереди по приоритетам, внутри - отдельная очередь на каждый slave
+    map<uint8_t, deque<Job>> commandQueues;
+    map<uint8_t, deque<Job>> pollQueues;
+    uint8_t lastCommandSlave = 0;
+    uint8_t lastPollSlave = 0;
+    
+    mutex queueMutex;
+    condition_variable queueCondition;
+    condition_variable exchangeDone;
+    atomic<bool> running;
+    thread worker;
+    RealtimeSettings realtime;
+    
+    static Lane laneFor(const uint8_t* request);
+    void enqueue(uint8_t slaveId, const uint8_t* data, size_t length);
+    // Запрос и ответ для канала: очередь - до queueTimeout, ответ - окно (deadline - сейчас) с начала обмена
+    TransactResult exchange(uint8_t slaveId, const uint8_t* request, size_t length, ReplySpec reply, chrono::steady_clock::time_point deadline);
+    // Broadcast от канала: в очередь команд, ждем пока выйдет на линию и пройдет turnaround
+    bool broadcast(const uint8_t* request, size_t length, chrono::milliseconds turnaround);
+    // Поставить обмен вызывающего и дождаться исхода. Не начался до startBy - снять
+    TransactResult await(Job& job, Exchange& exchange);
+    // Снять из очереди обмен, до которого не дошло (под queueMutex)
+    bool cancel(uint8_t slaveId, Lane lane, Exchange* exchange);
+    bool popNext(Job& job);
+    bool popRoundRobin(map<uint8_t, deque<Job>>& queues, uint8_t& lastSlave, Job& job);
+    void execute(const Job& job);
+    void finish(const Job& job, TransactResult result);
+    void workerLoop();
+};
+
+#endif /* ModbusBusMaster_hpp */
@@ -0,0 +1,72 @@
+//
+//  ModbusException.hpp
+//  Parking
+//
+
+#ifndef ModbusException_hpp
+#define ModbusException_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+
+using namespace std;
+
+// Коды исключений из ответа slave (ID + FC|0x80 + Код + CRC)
+enum class ModbusExceptionCode: uint8_t {
+    ILLEGAL_FUNCTION = 0x01,
+    ILLEGAL_DATA_ADDRESS = 0x02,
+    ILLEGAL_DATA_VALUE = 0x03,
+    SLAVE_DEVICE_FAILURE = 0x04,
+    ACKNOWLEDGE = 0x05,
+    SLAVE_DEVICE_BUSY = 0x06,
+    GATEWAY_PATH_UNAVAILABLE = 0x0A,
+    GATEWAY_TARGET_FAILED = 0x0B
+};
+
+// Slave отказал в запросе. Отличается от таймаута: ответ пришел сразу, ждать дальше бессмысленно
+class ModbusException: public runtime_error {
+public:
+    // Размер кадра исключения в RTU
+    static constexpr size_t frameSize = 5;
+    
+    ModbusException(uint8_t slaveId, uint8_t function, uint8_t exceptionCode)
+        : runtime_error("Шлагбаум " + to_string(slaveId) + " отклонил команду 0x" + hex(function) + ": " + describe(exceptionCode)),
+          slave(slaveId), functionCode(function), code(static_cast<ModbusExceptionCode>(exceptionCode)) {}
+    
+    uint8_t slaveId() const { return slave; }
+    uint8_t function() const { return functionCode; }
+    ModbusExceptionCode exceptionCode() const { return code; }
+    
+    // RTU кадр исключения? (CRC уже проверен фреймером)
+    static bool isException(const uint8_t* frame, size_t length) {
+        return length == frameSize && (frame[1] & 0x80) != 0;
+    }
+    
+    static const char* describe(uint8_t exceptionCode) {
+        switch (static_cast<ModbusExceptionCode>(exceptionCode)) {
+            case ModbusExceptionCode::ILLEGAL_FUNCTION: return "неподдерживаемая функция";
+            case ModbusExceptionCode::ILLEGAL_DATA_ADDRESS: return "неверный адрес";
+            case ModbusExceptionCode::ILLEGAL_DATA_VALUE: return "неверное значение";
+            case ModbusExceptionCode::SLAVE_DEVICE_FAILURE: return "сбой устройства";
+            case ModbusExceptionCode::ACKNOWLEDGE: return "команда принята, выполняется долго";
+            case ModbusExceptionCode::SLAVE_DEVICE_BUSY: return "устройство занято";
+            case ModbusExceptionCode::GATEWAY_PATH_UNAVAILABLE: return "шлюз: нет пути";
+            case ModbusExceptionCode::GATEWAY_TARGET_FAILED: return "шлюз: устройство не ответило";
+            default: return "неизвестная ошибка";
+        }
+    }
+    
+private:
+    uint8_t slave;
+    uint8_t functionCode;
+    ModbusExceptionCode code;
+    
+    static string hex(uint8_t value) {
+        const char digits[] = "0123456789ABCDEF";
+        return { digits[value >> 4], digits[value & 0x0F] };
+    }
+};
+
+#endif /* ModbusException_hpp */
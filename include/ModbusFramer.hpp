@@ -0,0 +1,87 @@
+//
+//  ModbusFramer.hpp
+//  Parking
+//
+
+#ifndef ModbusFramer_hpp
+#define ModbusFramer_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+using namespace std;
+
+// Готовый кадр, указывает во внутренний буфер фреймера.
+// Действителен до следующего вызова feed()/nextFrame().
+struct ModbusRtuFrame {
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    
+    uint8_t address() const { return data[0]; }
+    uint8_t function() const { return data[1]; }
+    bool isException() const { return (data[1] & 0x80) != 0; }
+};
+
+// Потоковый разборщик Modbus RTU.
+// Принимает байты по мере прихода, ищет границы кадров по паузе 3.5 символа
+// и по длине, которую можно предсказать из кода функции. Отдает только кадры с верным CRC,
+// все что не сложилось в кадр считается мусором.
+class ModbusRtuFramer {
+public:
+    using Clock = chrono::steady_clock;
+    
+    // Что разбираем: ответы slave (мы master) или запросы master (мы slave/эмулятор)
+    enum class Direction {
+        Response,
+        Request
+    };
+    
+    // Максимальный размер RTU кадра по стандарту
+    static constexpr size_t maxFrameSize = 256;
+    
+    explicit ModbusRtuFramer(int baudRate = 9600, Direction direction = Direction::Response);
+    
+    void setBaudRate(int baudRate);
+    // false - паузы между пачками не границы кадров (TCP шлюз: это задержки сети, а не линии),
+    // кадры только по длине и CRC
+    void setGapDetection(bool enabled) { gapDetection = enabled; }
+    // Пауза между кадрами (t3.5)
+    chrono::microseconds silenceInterval() const { return silence; }
+    
+    // Добавляем пришедшие байты. now - время прихода пачки
+    void feed(const uint8_t* data, size_t length, Clock::time_point now = Clock::now());
+    // Достаем следующий проверенный кадр, если он уже собрался
+    bool nextFrame(ModbusRtuFrame& frame);
+    // Сколько байт лежит в буфере и еще не стало кадром
+    size_t pending() const { return tail - head; }
+    void reset();
+    
+    // Статистика
+    size_t framesCount() const { return frames; }
+    size_t garbageCount() const { return garbageBytes; }
+    size_t crcErrorsCount() const { return crcErrors; }
+    
+private:
+    Direction direction;
+    chrono::microseconds silence;
+    bool gapDetection = true;
+    
+    uint8_t buffer[maxFrameSize * 2];
+    size_t head = 0;
+    size_t tail = 0;
+    Clock::time_point lastByteTime;
+    
+    size_t frames = 0;
+    size_t garbageBytes = 0;
+    size_t crcErrors = 0;
+    
+    // Длина кадра, начинающегося с offset: 0 - нужно больше байт, -1 - такого кадра не бывает
+    int predictLength(size_t offset = 0) const;
+    // Смещение первого целого кадра с верным CRC после начала буфера, 0 - не нашли
+    size_t findCompleteFrame() const;
+    void drop(size_t count);
+};
+
+#endif /* ModbusFramer_hpp */
@@ -0,0 +1,77 @@
+//
+//  ModbusTcpTransport.hpp
+//  Parking
+//
+
+#ifndef ModbusTcpTransport_hpp
+#define ModbusTcpTransport_hpp
+
+#include <stdio.h>
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <condition_variable>
+#include "TcpTransport.hpp"
+
+using namespace std;
+
+// Modbus TCP: вместо адреса и CRC кадр оборачивается в MBAP заголовок
+// (Transaction ID, Protocol ID = 0, Length, Unit ID).
+//
+// Снаружи транспорт принимает и отдает обычные RTU кадры, поэтому GateController работает с ним как с портом.
+// Для конвейера есть submit()/awaitReply(): несколько запросов в полете, ответы сопоставляются по Transaction ID.
+// transact идет через них же: очередь шины не нужна, опрос и команда могут быть в полете одновременно,
+// а запоздавший ответ на брошенный запрос просто не совпадет по ID.
+class ModbusTcpTransport: public TcpTransport {
+public:
+    static constexpr size_t mbapHeaderSize = 7;
+    
+    explicit ModbusTcpTransport(int connectTimeoutMs = 2000);
+    
+    using ICommunication::sendBytes;
+    using ICommunication::readBytes;
+    
+    // RTU кадр -> MBAP + PDU. Ответ потом читается через readAvailable/readBytes
+    bool sendBytes(const uint8_t* data, size_t length) override;
+    int readAvailable(uint8_t* buffer, int capacity, int timeoutMs) override;
+    void flush() override;
+    TransactResult transact(const uint8_t* request, size_t length, ReplySpec reply, chrono::steady_clock::time_point deadline) override;
+    
+    // Отправить RTU кадр, не дожидаясь ответа. Возвращает Transaction ID или -1
+    int submit(const uint8_t* rtuFrame, size_t length);
+    // Дождаться ответа на конкретный запрос (в RTU виде, с CRC). Длина ответа или -1
+    int awaitReply(uint16_t transactionId, uint8_t* reply, size_t capacity, int timeoutMs);
+    
+    size_t inFlight();
+    // Ответы с Transaction ID, которого никто не ждет (брошенные или чужие)
+    size_t unmatchedCount();
+    
+private:
+    uint16_t nextTransactionId = 1;
+    
+    mutex stateMutex;
+    condition_variable replyCondition;
+    // Запросы, чей ответ ждут через awaitReply
+    set<uint16_t> pipelined;
+    map<uint16_t, vector<uint8_t>> completed;
+    // Запросы из sendBytes, ответы уходят в общий поток байт
+    set<uint16_t> streamed;
+    deque<uint8_t> streamReplies;
+    size_t unmatched = 0;
+    // Кто-то сейчас читает сокет (держит recvMutex). Ждущие просыпаются, когда он уходит
+    bool reading = false;
+    
+    // Сырые байты из сокета, которые еще не сложились в целый ADU
+    uint8_t rxBuffer[1024];
+    size_t rxLength = 0;
+    
+    int sendFrame(const uint8_t* rtuFrame, size_t length, bool pipeline);
+    // Читаем сокет и раскладываем целые ADU по ожидающим. false - ошибка соединения
+    bool receive(int timeoutMs);
+    // receive под recvMutex: отмечает читающего и будит ждущих после каждой порции
+    bool pump(int timeoutMs);
+    void dispatch(const uint8_t* adu, size_t length);
+};
+
+#endif /* ModbusTcpTransport_hpp */
@@ -9,17 +9,63 @@
 #define ModbusUtils_hpp
 
 #include <vector>
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <algorithm>
 #include <stdio.h>
 using namespace std;
 
+// Таблицы CRC16 Modbus (полином 0xA001, отраженный).
+// crcTables[0] - обычная побайтовая таблица,
+// crcTables[k] - вклад байта, за которым идут еще k байт (для slice-by-N).
+using CRCTables = array<array<uint16_t, 256>, 8>;
+
+constexpr CRCTables makeCRCTables() {
+    CRCTables tables = {};
+    
+    for (uint16_t i = 0; i < 256; i++) {
+        uint16_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x0001) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+        }
+        tables[0][i] = crc;
+    }
+    
+    for (size_t k = 1; k < tables.size(); k++) {
+        for (size_t i = 0; i < 256; i++) {
+            uint16_t prev = tables[k - 1][i];
+            tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+        }
+    }
+    
+    return tables;
+}
+
 class ModbusUtils {
 public:
-    // Статический метод расчета CRC
+    static constexpr CRCTables crcTables = makeCRCTables();
+    
+    // С какой длины выгоднее slice-by-8, короче - побайтовая таблица
+    static constexpr size_t sliceThreshold = 16;
+    
+    // Основной метод расчета CRC, сам выбирает вариант по длине данных
+    static uint16_t calculateCRC(const uint8_t* data, size_t length) {
+        if (length < sliceThreshold) {
+            return calculateCRCTable(data, length);
+        }
+        return calculateCRCSlice8(data, length);
+    }
+    
     static uint16_t calculateCRC(const std::vector<uint8_t>& data) {
+        return calculateCRC(data.data(), data.size());
+    }
+    
+    // Эталонный побитовый расчет (8 сдвигов на байт), оставлен для сверки и бенчмарка
+    static constexpr uint16_t calculateCRCBitwise(const uint8_t* data, size_t length) {
         uint16_t crc = 0xFFFF;
         
-        for (size_t pos = 0; pos < data.size(); pos++) {
+        for (size_t pos = 0; pos < length; pos++) {
             crc ^= (uint16_t)data[pos]; // XOR byte into least sig. byte of crc
             
             for (int i = 8; i != 0; i--) { // Loop over each bit
@@ -35,10 +81,26 @@ public:
         // но сам расчет выдает число. Разделять на байты будем при отправке.
         return crc;
     }
+    
+    // Побайтовый табличный расчет, работает и в constexpr
+    static constexpr uint16_t calculateCRCTable(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+        for (size_t pos = 0; pos < length; pos++) {
+            crc = (crc >> 8) ^ crcTables[0][(crc ^ data[pos]) & 0xFF];
+        }
+        return crc;
+    }
+    
+    // Slice-by-4 и slice-by-8: по 4/8 байт за итерацию, хвост добиваем таблицей
+    static uint16_t calculateCRCSlice4(const uint8_t* data, size_t length);
+    static uint16_t calculateCRCSlice8(const uint8_t* data, size_t length);
 };
 
+// Адрес 0 - широковещательный: команду выполняют все slave на линии, ответа не будет
+constexpr uint8_t ModbusBroadcastAddress = 0x00;
+
 enum class Command: uint8_t {
     WRITE_SINGL_COIL = 0x05,
+    WRITE_MULTIPLE_COILS = 0x0F,
     READ_COILS = 0x01,
     READ_DSSCRETE_INPUTS = 0x02,
     READ_INPUT_REGISTERS = 0x04
@@ -48,38 +110,145 @@ enum class Action: uint16_t {
     OPEN = 0xFF00,
     CLOSE = 0x0000,
     SINGLE = 0x0008,
-    ONE_REGISTER = 0x0001
+    ONE_REGISTER = 0x0001,
+    TWO_INPUTS = 0x0002
 };
 
 struct ModbusFrame {
+    // Размер запроса: ID(1) + FC(1) + Reg(2) + Value(2) + CRC(2)
+    static constexpr size_t size = 8;
+    using Buffer = array<uint8_t, size>;
+    
     uint8_t address; // Адрес устройства
     Command commandCode; // Команда
     uint16_t registerAddr; // Куда пишем
     Action value; // Что пишем
     
-    vector<uint8_t> serialize() {
-        vector<uint8_t> buffer;
-        
-        buffer.push_back(address);
-        buffer.push_back(static_cast<uint8_t>(commandCode));
+    // Пишем кадр в буфер вызывающего (не меньше size байт), без аллокаций
+    void encode(uint8_t* out) const {
+        out[0] = address;
+        out[1] = static_cast<uint8_t>(commandCode);
         
         // Modbus Big-Endian (Старший байт первый)
-        buffer.push_back((registerAddr >> 8) & 0xFF);
-        buffer.push_back(registerAddr & 0xFF);
+        out[2] = (registerAddr >> 8) & 0xFF;
+        out[3] = registerAddr & 0xFF;
         
-        buffer.push_back((static_cast<uint16_t>(value) >> 8) & 0xFF);
-        buffer.push_back(static_cast<uint16_t>(value) & 0xFF);
+        out[4] = (static_cast<uint16_t>(value) >> 8) & 0xFF;
+        out[5] = static_cast<uint16_t>(value) & 0xFF;
         
         // Считаем CRC
-        uint16_t crc = ModbusUtils::calculateCRC(buffer);
+        uint16_t crc = ModbusUtils::calculateCRC(out, size - 2);
         
         // Modbus Little-Endian (Младший байт первый)
-        buffer.push_back(crc & 0xFF);
-        buffer.push_back((crc >> 8) & 0xFF);
-        
+        out[6] = crc & 0xFF;
+        out[7] = (crc >> 8) & 0xFF;
+    }
+    
+    void encode(Buffer& out) const {
+        encode(out.data());
+    }
+    
+    Buffer encode() const {
+        Buffer buffer;
+        encode(buffer);
         return buffer;
     }
     
+    vector<uint8_t> serialize() const {
+        Buffer buffer = encode();
+        return vector<uint8_t>(buffer.begin(), buffer.end());
+    }
+    
+    // То же что encode(), но считается на этапе компиляции
+    static constexpr Buffer build(uint8_t address, Command command, uint16_t registerAddr, Action value) {
+        Buffer out = {};
+        out[0] = address;
+        out[1] = static_cast<uint8_t>(command);
+        out[2] = (registerAddr >> 8) & 0xFF;
+        out[3] = registerAddr & 0xFF;
+        out[4] = (static_cast<uint16_t>(value) >> 8) & 0xFF;
+        out[5] = static_cast<uint16_t>(value) & 0xFF;
+        
+        uint16_t crc = ModbusUtils::calculateCRCTable(out.data(), size - 2);
+        out[6] = crc & 0xFF;
+        out[7] = (crc >> 8) & 0xFF;
+        return out;
+    }
+    
 };
 
+// Write Multiple Coils (0x0F): всем coils из диапазона пишем одно значение
+struct ModbusCoilsFrame {
+    // ID(1) + FC(1) + Start(2) + Qty(2) + ByteCount(1) + Данные(до 246) + CRC(2)
+    static constexpr uint16_t maxQuantity = 1968;
+    static constexpr size_t maxSize = 7 + maxQuantity / 8 + 2;
+    
+    uint8_t address;
+    uint16_t startAddr;
+    uint16_t quantity;
+    bool value;
+    
+    // Возвращает длину кадра, 0 - неверное кол-во coils
+    size_t encode(uint8_t* out) const {
+        if (quantity == 0 || quantity > maxQuantity) return 0;
+        
+        size_t byteCount = (quantity + 7) / 8;
+        out[0] = address;
+        out[1] = static_cast<uint8_t>(Command::WRITE_MULTIPLE_COILS);
+        out[2] = (startAddr >> 8) & 0xFF;
+        out[3] = startAddr & 0xFF;
+        out[4] = (quantity >> 8) & 0xFF;
+        out[5] = quantity & 0xFF;
+        out[6] = static_cast<uint8_t>(byteCount);
+        
+        // Биты coils, младший бит - первый coil, лишние биты последнего байта = 0
+        for (size_t i = 0; i < byteCount; i++) {
+            size_t bits = min<size_t>(8, quantity - i * 8);
+            out[7 + i] = value ? static_cast<uint8_t>((1u << bits) - 1) : 0x00;
+        }
+        
+        size_t length = 7 + byteCount;
+        uint16_t crc = ModbusUtils::calculateCRC(out, length);
+        out[length] = crc & 0xFF;
+        out[length + 1] = (crc >> 8) & 0xFF;
+        return length + 2;
+    }
+};
+
+// Фиксированный запрос, который зависит только от ID slave.
+// Кадры для всех 256 адресов собираются при компиляции (CRC тоже),
+// на горячем пути остается выбор из таблицы и write().
+template <Command C, uint16_t Reg, Action V>
+struct ModbusFrameT {
+    using Buffer = ModbusFrame::Buffer;
+    
+    static constexpr Buffer forAddress(uint8_t address) {
+        return ModbusFrame::build(address, C, Reg, V);
+    }
+    
+    static constexpr array<Buffer, 256> makeTable() {
+        array<Buffer, 256> table = {};
+        for (size_t address = 0; address < table.size(); address++) {
+            table[address] = forAddress(static_cast<uint8_t>(address));
+        }
+        return table;
+    }
+    
+    static constexpr array<Buffer, 256> bySlave = makeTable();
+    
+    // Кадр для ID, известного только во время работы
+    static const Buffer& forSlave(uint8_t address) {
+        return bySlave[address];
+    }
+};
+
+// Команды шлагбаума
+using OpenGateFrame = ModbusFrameT<Command::WRITE_SINGL_COIL, 0x0000, Action::OPEN>;
+using CloseGateFrame = ModbusFrameT<Command::WRITE_SINGL_COIL, 0x0000, Action::CLOSE>;
+// DI1 (закрыт), DI2 (открыт), оба концевика сразу, IR0 (положение)
+using ReadClosedFrame = ModbusFrameT<Command::READ_DSSCRETE_INPUTS, 0x0001, Action::SINGLE>;
+using ReadOpenedFrame = ModbusFrameT<Command::READ_DSSCRETE_INPUTS, 0x0002, Action::SINGLE>;
+using ReadLimitsFrame = ModbusFrameT<Command::READ_DSSCRETE_INPUTS, 0x0001, Action::TWO_INPUTS>;
+using ReadPositionFrame = ModbusFrameT<Command::READ_INPUT_REGISTERS, 0x0000, Action::ONE_REGISTER>;
+
 #endif /* ModbusUtils_hpp */
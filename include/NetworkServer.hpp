@@ -15,6 +15,9 @@
 #include "App.h"
 #include "json.hpp"
 #include "GateController.hpp"
+#include "GateStateCache.hpp"
+#include "GateCommandQueue.hpp"
+#include "GateGroup.hpp"
 #include "Database.hpp"
 
 using json = nlohmann::json;
@@ -25,7 +28,14 @@ private:
     using JSONHandler = function<json(json requestBody)>;
     
     GateController& controller;
+    GateStateCache& gateCache;
+    // Команды открыть/закрыть - только через очередь шлагбаума
+    GateCommandQueue& commands;
+    // Шлагбаумы линии вместе (nullptr - группы нет, /group/* отвечают 404)
+    GateGroup* group = nullptr;
     Database& db;
+    // Снимок старше - в ответе stale, и просим опрос (ответ не ждет шину)
+    chrono::milliseconds statusMaxAge{2000};
     string apiKey;
     
     uWS::Loop* loop = nullptr;
@@ -35,8 +45,14 @@ private:
     
     // В uWebSocket нету нормального парсера Body из post запроса, сделал этот helper.
     void postJSON(uWS::HttpResponse<false>* res, JSONHandler handler);
+    // /open и /close: в очередь, 429 если полна. ?wait=1 - ответ после исхода команды
+    void gateCommand(uWS::HttpResponse<false>* res, uWS::HttpRequest* req, GateCommand command);
+    // /group/open и /group/close: ответ сразу, исход - событием GROUP_COMMAND. 429 если группа занята
+    void groupCommand(uWS::HttpResponse<false>* res, GateCommand command);
 public:
-    NetworkServer(GateController& gc, Database& db, const string& key);
+    NetworkServer(GateController& gc, GateStateCache& cache, GateCommandQueue& queue, Database& db, const string& key);
+    void setStatusMaxAge(chrono::milliseconds maxAge) { statusMaxAge = maxAge; }
+    void setGroup(GateGroup* gateGroup) { group = gateGroup; }
     void start(int port);
     void broadcastEvent(const string& eventType, const json& data);
 };
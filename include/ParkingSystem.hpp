@@ -12,24 +12,62 @@
 #include "ConfigLoader.hpp"
 #include "Database.hpp"
 #include "SerialPort.hpp"
+#include "TcpTransport.hpp"
+#include "ModbusTcpTransport.hpp"
 #include "GateController.hpp"
+#include "GateStateCache.hpp"
+#include "GateCommandQueue.hpp"
+#include "TimerWheel.hpp"
+#include "LaneMetrics.hpp"
 #include "RfidReader.hpp"
 #include "NetworkServer.hpp"
 #include "ServiceBeacon.hpp"
+#include "SerialReactor.hpp"
+#include "WireCapture.hpp"
+#include "ModbusBusMaster.hpp"
+#include "GateGroup.hpp"
 
 using namespace std;
 
 class ParkingSystem {
 private:
     ConfigLoader config;
+    // Один поток на RFID и таймеры (создаем первым - разрушается последним).
+    // Шлагбаум на serial принимает свой поток порта (startReceiver), обмены - поток gateBus
+    SerialReactor reactor;
+    // Один поток на все отложенные действия (автозакрытие), раньше очереди команд - переживет ее
+    TimerWheel timers;
     Database db;
-    SerialPort gatePort;
+    // Линия шлагбаумов по gate_transport: serial, tcp (Modbus TCP), rtu_tcp (шлюз RTU over TCP)
+    // или replay (файл захвата). gateSerial - тот же порт, если это serial (прием в фоне, гистограмма пробуждений)
+    unique_ptr<ICommunication> gatePort;
+    SerialPort* gateSerial = nullptr;
+    size_t reportedOverrun = 0; // Сколько потерянных байт кольца приема уже попало в лог
+    // replay: записанные байты считывателя вместо порта RFID
+    unique_ptr<CapturePlayer> rfidReplay;
+    // Запись обмена со шлагбаумом и байтов RFID (capture_file в конфиге), без него - просто прокси
+    CaptureTransport gateCapture;
+    // Все обмены со шлагбаумами линии - одним потоком, команды вне очереди опросов
+    ModbusBusMaster gateBus;
     GateController controller;
+    // Единственный опросчик шлагбаума, остальные читают снимок
+    GateStateCache gateCache;
+    // Открыть/закрыть от API и RFID - по очереди, одним потоком
+    GateCommandQueue gateCommands;
+    // Остальные шлагбаумы той же линии (group_barrier_ids) и группа вместе с нашим
+    vector<unique_ptr<GateController>> groupControllers;
+    unique_ptr<GateGroup> gateGroup;
+    // Проезды и циклы шлагбаума - машин в минуту по полосе
+    LaneMetrics lane;
     RfidReader rfidReader;
     NetworkServer networkServer;
     
     void setup();
     void processRFIDCard(const string& cardCode);
+    // Опрос шлагбаума по таймеру reactor, изменения - в websocket
+    void pollGateState();
+    int lastBarrierState = -1;
+    GatePhase lastPhase = GatePhase::Unknown;
     unique_ptr<ServiceBeacon> beacon;
     
 public:
@@ -0,0 +1,40 @@
+//
+//  RealtimeThread.hpp
+//  Parking
+//
+
+#ifndef RealtimeThread_hpp
+#define RealtimeThread_hpp
+
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+// Планирование потока ввода-вывода шины: приоритет реального времени, ядро, память.
+// Окно ответа шлагбаума - десятки мс, и поток приема не должен ждать своей очереди за uWS и SQLite
+struct RealtimeSettings {
+    enum class Policy {
+        Normal,     // SCHED_OTHER, как все
+        Fifo,       // SCHED_FIFO
+        RoundRobin  // SCHED_RR
+    };
+
+    Policy policy = Policy::Normal;
+    int priority = 0;           // 1..99 для Fifo/RoundRobin
+    int cpu = -1;               // Закрепить за ядром, -1 - любое
+    bool lockMemory = false;    // mlockall: без page fault на горячем пути
+
+    bool enabled() const { return policy != Policy::Normal || cpu >= 0 || lockMemory; }
+
+    // "fifo", "rr", остальное - Normal
+    static Policy parsePolicy(const string& name);
+};
+
+namespace Realtime {
+    // Применить к текущему потоку. Без прав (CAP_SYS_NICE, RLIMIT_MEMLOCK) пишет в лог
+    // и продолжает как обычный поток. false - что-то не применилось
+    bool applyToCurrentThread(const RealtimeSettings& settings, const string& threadName);
+}
+
+#endif /* RealtimeThread_hpp */
@@ -10,60 +10,42 @@
 
 #include <stdio.h>
 #include "SerialPort.hpp"
+#include "SerialReactor.hpp"
+#include "WireCapture.hpp"
 #include <functional>
-#include <thread>
-#include <atomic>
-#include <iostream>
+#include <string>
 
 using namespace std;
 
 class RfidReader {
 private:
     SerialPort port;
-    atomic<bool> running;
-    thread worker;
-    
+    // Код карты копится до \n или \r - считыватель может отдать его несколькими кусками
+    string line;
+
     // callback: когда прочитали карту
     function<void(string)> onCardRead;
+    // Запись того, что пришло со считывателя, в общий с шлагбаумом файл захвата
+    CaptureTransport* capture = nullptr;
 public:
-    RfidReader() : running(false) {}
-    
-    bool connect(const string& portName) {
+    bool connect(const string& portName, const SerialSettings& settings = SerialSettings()) {
+        port.configure(settings);
         return port.connect(portName);
     }
-    
+
     void setCallBack(function<void(string)> cb) {
         onCardRead = cb;
     }
-    
-    void start() {
-        running = true;
-        
-        worker = thread([this]() {
-            while (running) {
-                vector<uint8_t> buffer;
-                int n = port.readBytes(buffer, 10, 1);
-                
-                if (n > 0) {
-                    string cardCode(buffer.begin(), buffer.end());
-                    cardCode.erase(remove(cardCode.begin(), cardCode.end(), '\n'), cardCode.end());
-                    cardCode.erase(remove(cardCode.begin(), cardCode.end(), '\r'), cardCode.end());
-                    if (!cardCode.empty() && onCardRead) {
-                        onCardRead(cardCode);
-                    }
-                }
-            }
-        });
-        
-        worker.detach();
-    }
-    
-    void stop() {
-        running = false;
-        if (worker.joinable()) {
-            worker.join();
-        }
+
+    // Байты со считывателя пишутся каналом Rfid (пишет, только пока capture записывает). До attach
+    void setCapture(CaptureTransport* target) {
+        capture = target;
     }
+
+    // Порт слушает reactor, отдельный поток под считыватель не нужен
+    bool attach(SerialReactor& reactor);
+    // Байты со считывателя (из reactor или из записанного захвата)
+    void feed(const uint8_t* data, size_t length);
 };
 
 #endif /* RfidReader_hpp */
@@ -0,0 +1,69 @@
+//
+//  Seqlock.hpp
+//  Parking
+//
+
+#ifndef Seqlock_hpp
+#define Seqlock_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+using namespace std;
+
+// Последнее значение T для многих читателей и одного писателя, без блокировок.
+// Писатель не ждет никого; читатель повторяет чтение, если попал на запись.
+// Данные лежат в атомарных словах, чтобы одновременное чтение и запись не были гонкой по стандарту
+template <typename T>
+class Seqlock {
+    static_assert(is_trivially_copyable<T>::value, "Seqlock хранит только тривиально копируемые типы");
+private:
+    static constexpr size_t wordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // Нечетное значение - идет запись
+    alignas(64) atomic<uint64_t> sequence{0};
+    atomic<uint64_t> words[wordCount];
+public:
+    Seqlock() : Seqlock(T()) {}
+    explicit Seqlock(const T& initial) { store(initial); }
+
+    // Только один писатель одновременно
+    void store(const T& value) {
+        uint64_t buffer[wordCount] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        uint64_t s = sequence.load(memory_order_relaxed);
+        sequence.store(s + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for (size_t i = 0; i < wordCount; i++) {
+            words[i].store(buffer[i], memory_order_relaxed);
+        }
+        sequence.store(s + 2, memory_order_release);
+    }
+
+    T load() const {
+        uint64_t buffer[wordCount];
+        while (true) {
+            uint64_t before = sequence.load(memory_order_acquire);
+            if (before & 1) continue;
+
+            for (size_t i = 0; i < wordCount; i++) {
+                buffer[i] = words[i].load(memory_order_relaxed);
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (sequence.load(memory_order_relaxed) == before) break;
+        }
+
+        T value;
+        memcpy(&value, buffer, sizeof(T));
+        return value;
+    }
+
+    // Номер записи, растет с каждой store
+    uint64_t version() const { return sequence.load(memory_order_acquire) / 2; }
+};
+
+#endif /* Seqlock_hpp */
@@ -12,24 +12,130 @@
 #include <string>
 #include <vector>
 #include <mutex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 #include "ICommunication.h"
+#include "SpscRingBuffer.hpp"
+#include "RealtimeThread.hpp"
+#include "LatencyHistogram.hpp"
 
 using namespace std;
 
+// Параметры линии. По умолчанию - прежние 9600 8N1
+struct SerialSettings {
+    int baudRate = 9600;
+    int dataBits = 8;
+    char parity = 'N';     // N - нет, E - четный, O - нечетный
+    int stopBits = 1;
+    
+    // RS-485 (TIOCSRS485, только Linux): драйвер сам переключает DE/RE на передачу
+    bool rs485 = false;
+    int rs485DelayBeforeSendMs = 0;
+    int rs485DelayAfterSendMs = 0;
+    
+    // Сырые VMIN/VTIME. Ожидание у нас на poll, поэтому по умолчанию read не ждет
+    int vmin = 0;
+    int vtime = 0;
+    
+    // Бит на символ: старт + данные + четность + стоп
+    int bitsPerChar() const {
+        return 1 + dataBits + (parity == 'N' ? 0 : 1) + stopBits;
+    }
+    
+    // Время передачи bytes байт по линии
+    chrono::microseconds lineTime(size_t bytes) const {
+        return chrono::microseconds(1000000LL * bitsPerChar() * static_cast<long long>(bytes) / baudRate);
+    }
+    
+    // Окно ожидания ответа: запрос и ответ на линии + время на обработку в slave
+    int replyTimeoutMs(size_t requestBytes, size_t replyBytes, int processingMs = 30) const {
+        auto wire = chrono::ceil<chrono::milliseconds>(lineTime(requestBytes + replyBytes));
+        return static_cast<int>(wire.count()) + processingMs;
+    }
+};
+
 class SerialPort: public ICommunication {
 private:
     mutex portMutex;
     int fileDescriptor;
     bool isConnect;
+    SerialSettings lineSettings;
+    
+    // Скорость, которой нет среди Bxxx (termios2/BOTHER на Linux, IOSSIOSPEED на macOS)
+    bool setCustomBaudRate(int baudRate);
+    // Режим RS-485 драйвера
+    bool applyRs485();
+    
+    /// Ждем данных на порту до дедлайна. 1 - есть данные, 0 - таймаут, -1 - ошибка
+    int waitReadable(chrono::steady_clock::time_point deadline);
+    
+    // Фоновый прием: поток receiver забирает все из драйвера в кольцо,
+    // читатели берут уже оттуда. Ни один байт не теряется между транзакциями.
+    // Свой поток, а не SerialReactor: метка порции ставится сразу после read,
+    // и обработчики reactor (RFID, БД) не задерживают прием ответа
+    SpscRingBuffer<4096> rxRing;
+    // Время прихода каждой порции: где она кончается в потоке байт кольца и когда read ее вернул.
+    // Читатель отдает не больше одной порции за раз и с ее временем - фреймер видит паузы линии,
+    // а не то, когда до байтов дошла очередь
+    struct RxStamp {
+        size_t end;
+        chrono::steady_clock::time_point at;
+    };
+    SpscRingBuffer<256, RxStamp> rxStamps;
+    size_t rxWritten = 0;   // Поток приема: байт положено в кольцо за все время
+    size_t rxConsumed = 0;  // Читатель: байт забрано или выброшено flush
+    atomic<size_t> rxDropped; // Поток приема: байт не влезло в кольцо, читают из любого потока
+    thread receiver;
+    atomic<bool> receiving;
+    int stopPipe[2] = {-1, -1};
+    // Только чтобы усыпить читателя на пустом кольце, сами данные идут мимо мьютекса
+    mutex rxMutex;
+    condition_variable rxReady;
+    
+    // Планирование потока приема и его задержка пробуждения: раз в latencyProbeMs
+    // поток просыпается по таймауту poll, опоздание против заказанного - в гистограмму
+    static constexpr int latencyProbeMs = 100;
+    RealtimeSettings receiverRealtime;
+    LatencyHistogram wakeupHistogram;
+    
+    void receiveLoop();
+    int readFromRing(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt);
 public:
     SerialPort();
     ~SerialPort() override;
 
+    // Параметры применяются при connect
+    void configure(const SerialSettings& settings) { lineSettings = settings; }
+    const SerialSettings& settings() const { return lineSettings; }
+    
     bool connect(const std::string& address) override;
     void disconnect() override;
-    bool sendBytes(const std::vector<uint8_t>& data) override;
-    int readBytes(std::vector<uint8_t>& buffer, int expected, int timeout) override;
+    using ICommunication::sendBytes;
+    using ICommunication::sendParts;
+    using ICommunication::readBytes;
+    // Запись ждет освобождения буфера драйвера не дольше времени кадра на линии + 100 мс
+    bool sendBytes(const uint8_t* data, size_t length) override;
+    bool sendParts(const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline) override;
+    int readBytesUntil(uint8_t* buffer, int expected, chrono::steady_clock::time_point deadline) override;
+    int readAvailable(uint8_t* buffer, int capacity, int timeoutMs) override;
+    int readChunk(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt) override;
     void flush() override;
+    
+    // Включить фоновый прием (после connect). Читать порт после этого может только один поток
+    bool startReceiver();
+    void stopReceiver();
+    // Приоритет/ядро потока приема, задается до startReceiver
+    void setReceiverRealtime(const RealtimeSettings& settings) { receiverRealtime = settings; }
+    // Насколько поток приема опаздывает проснуться (мкс)
+    const LatencyHistogram& wakeupLatency() const { return wakeupHistogram; }
+    // Байты, не влезшие в кольцо (читатель не успевает) - прием их выбросил
+    size_t overrunCount() const { return rxDropped; }
+    
+    // fd для SerialReactor (RFID). Порт с фоновым приемом в reactor не добавляем -
+    // читать fd может только один поток
+    int nativeHandle() const { return fileDescriptor; }
 };
 
 #endif /* SerialPort_hpp */
@@ -0,0 +1,75 @@
+//
+//  SerialReactor.hpp
+//  Parking
+//
+
+#ifndef SerialReactor_hpp
+#define SerialReactor_hpp
+
+#include <stdio.h>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+using namespace std;
+
+// Один поток на порты без жестких сроков (RFID) и таймеры: ждет данные на всех fd сразу,
+// раздает их обработчикам и крутит таймеры опроса.
+// Порт шлагбаума сюда не входит - его принимает свой поток (SerialPort::startReceiver):
+// ответу Modbus нужны окно в десятки мс и метка времени каждой порции для t3.5,
+// а обработчик здесь может надолго занять поток (RFID -> проверка в БД).
+// Linux - epoll + timerfd + eventfd, на остальных (macOS) - poll + pipe.
+class SerialReactor {
+public:
+    using ReadHandler = function<void(const uint8_t* data, size_t length)>;
+    using Task = function<void()>;
+private:
+    struct Timer {
+        int id;
+        chrono::milliseconds interval;
+        chrono::steady_clock::time_point next;
+        Task callback;
+    };
+
+    int pollFd = -1;     // epoll (только Linux)
+    int timerFd = -1;    // timerfd (только Linux)
+    int wakeFds[2] = {-1, -1}; // eventfd в [0] на Linux, pipe на остальных - будит stop()
+
+    // fd и таймеры трогаем только из потока reactor (или до run)
+    map<int, ReadHandler> handlers;
+    vector<Timer> timers;
+    int nextTimerId = 1;
+
+    atomic<bool> running;
+
+    void wakeup();
+    void drainWakeup();
+    void runTimers();
+    void armTimer();
+    int nextTimeoutMs() const;
+    void dispatch(int fd);
+    void waitEvents();
+public:
+    SerialReactor();
+    ~SerialReactor();
+
+    SerialReactor(const SerialReactor&) = delete;
+    SerialReactor& operator=(const SerialReactor&) = delete;
+
+    // Регистрация порта: handler получает все, что пришло на fd
+    bool add(int fd, ReadHandler handler);
+    void remove(int fd);
+
+    // Периодический таймер, первый запуск через interval. Возвращает id для отмены
+    int addTimer(chrono::milliseconds interval, Task callback);
+    void cancelTimer(int id);
+
+    // Крутит цикл в текущем потоке до stop()
+    void run();
+    void stop();
+};
+
+#endif /* SerialReactor_hpp */
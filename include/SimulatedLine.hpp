@@ -0,0 +1,143 @@
+//
+//  SimulatedLine.hpp
+//  Parking
+//
+
+#ifndef SimulatedLine_hpp
+#define SimulatedLine_hpp
+
+#include <stdio.h>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <random>
+#include <functional>
+#include <chrono>
+#include "ICommunication.h"
+#include "BarrierModel.hpp"
+#include "ModbusFramer.hpp"
+
+using namespace std;
+
+// Линия RS-485 в памяти процесса с виртуальными часами: два конца (master и slave),
+// каждый байт приходит на другой конец через время символа при заданной скорости,
+// может потеряться или побиться. Время идет только когда кто-то ждет данные,
+// поэтому прогон детерминирован и не зависит от загрузки машины.
+// Однопоточная: оба конца используются из одного потока.
+class SimulatedLine {
+public:
+    using Clock = chrono::steady_clock;
+
+    struct Options {
+        int baudRate = 9600;
+        int bitsPerChar = 10;       // 8N1
+        double lossRate = 0;        // Доля потерянных байт
+        double corruptionRate = 0;  // Доля байт с перевернутым битом
+        uint32_t seed = 1;          // Для повторяемых потерь
+    };
+
+    // Статистика линии
+    struct Stats {
+        uint64_t bytesSent = 0;
+        uint64_t bytesLost = 0;
+        uint64_t bytesCorrupted = 0;
+    };
+
+    class Endpoint: public ICommunication {
+        friend class SimulatedLine;
+    private:
+        SimulatedLine& line;
+        int side;
+        deque<uint8_t> inbox;
+        // Если заданы - байты отдаются им в момент прихода, а не копятся в inbox.
+        // Несколько - multi-drop: все slave на линии слышат каждый байт
+        vector<function<void(uint8_t)>> listeners;
+
+        Endpoint(SimulatedLine& owner, int index) : line(owner), side(index) {}
+    public:
+        bool connect(const string&) override { return true; }
+        void disconnect() override {}
+        void flush() override { inbox.clear(); }
+        bool sendBytes(const uint8_t* data, size_t length) override;
+        // Ожидание - в виртуальном времени
+        int readAvailable(uint8_t* buffer, int capacity, int timeoutMs) override;
+        // Время прихода - виртуальное
+        int readChunk(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt) override;
+        // Бюджет из реального deadline переносится на виртуальные часы
+        TransactResult transact(const uint8_t* request, size_t length, ReplySpec reply, chrono::steady_clock::time_point deadline) override;
+        // Пауза после broadcast - тоже виртуальная
+        bool broadcast(const uint8_t* request, size_t length, chrono::milliseconds turnaround) override;
+
+        void addListener(function<void(uint8_t)> handler) { listeners.push_back(move(handler)); }
+    };
+
+    SimulatedLine();
+    explicit SimulatedLine(const Options& options);
+
+    Endpoint& master() { return ends[0]; }
+    Endpoint& slave() { return ends[1]; }
+
+    // Виртуальное время (от нуля)
+    Clock::time_point now() const { return virtualNow; }
+    // Прокрутить время вперед, выполняя все что успеет произойти
+    void advance(chrono::microseconds duration);
+    // Выполнить действие в момент at (ответ slave с задержкой и т.п.)
+    void schedule(Clock::time_point at, function<void()> action);
+
+    int baudRate() const { return options.baudRate; }
+    chrono::microseconds charTime() const { return symbolTime; }
+    const Stats& stats() const { return lineStats; }
+
+private:
+    struct Event {
+        Clock::time_point at;
+        uint64_t order;     // При равном времени - в порядке постановки
+        int side = -1;      // Доставка байта на конец side
+        uint8_t byte = 0;
+        function<void()> action;
+
+        bool operator>(const Event& other) const {
+            return at != other.at ? at > other.at : order > other.order;
+        }
+    };
+
+    Options options;
+    Endpoint ends[2];
+    chrono::microseconds symbolTime;
+    Clock::time_point virtualNow;
+    // Когда линия освободится от передачи каждого конца
+    Clock::time_point txFreeAt[2];
+
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+    uint64_t nextOrder = 0;
+    mt19937 rng;
+    uniform_real_distribution<double> chance{0.0, 1.0};
+    Stats lineStats;
+
+    void transmit(int fromSide, const uint8_t* data, size_t length);
+    // Следующее событие не позже until. false - таких нет
+    bool step(Clock::time_point until);
+};
+
+// Шлагбаум на slave конце линии: собирает запросы фреймером по времени прихода байт,
+// отвечает через BarrierModel с задержкой на обработку. Их может быть несколько на одной линии
+// с разными ID - каждый отвечает только на свой адрес
+class SimulatedBarrier {
+private:
+    SimulatedLine& line;
+    BarrierModel model;
+    ModbusRtuFramer framer;
+    chrono::microseconds replyLatency;
+    uint8_t reply[ModbusRtuFramer::maxFrameSize];
+    size_t requests = 0;
+
+    void onByte(uint8_t byte);
+public:
+    SimulatedBarrier(SimulatedLine& simulatedLine, uint8_t slaveId = 1, int travelTimeMs = 5000,
+                     chrono::microseconds latency = chrono::milliseconds(5));
+
+    BarrierModel& barrier() { return model; }
+    size_t requestsCount() const { return requests; }
+};
+
+#endif /* SimulatedLine_hpp */
@@ -0,0 +1,99 @@
+//
+//  SpscRingBuffer.hpp
+//  Parking
+//
+
+#ifndef SpscRingBuffer_hpp
+#define SpscRingBuffer_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+using namespace std;
+
+// Кольцевой буфер без блокировок: один поток пишет, один читает.
+// Индексы растут бесконечно, позиция в массиве - по маске (Capacity - степень двойки).
+// По умолчанию байты, но подойдет любой тривиально копируемый T (метки времени приема)
+template <size_t Capacity, typename T = uint8_t>
+class SpscRingBuffer {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity должна быть степенью двойки");
+    static_assert(is_trivially_copyable<T>::value, "T копируется memcpy");
+private:
+    T data[Capacity];
+    // Разнесены по кеш-линиям, чтобы писатель и читатель не мешали друг другу
+    alignas(64) atomic<size_t> head{0}; // двигает читатель
+    alignas(64) atomic<size_t> tail{0}; // двигает писатель
+    size_t overflow = 0;                // писатель: сколько элементов не влезло
+
+    // Копия с учетом перехода через конец массива
+    static void copyIn(T* ring, size_t position, const T* src, size_t length) {
+        size_t offset = position & (Capacity - 1);
+        size_t first = min(length, Capacity - offset);
+        memcpy(ring + offset, src, first * sizeof(T));
+        memcpy(ring, src + first, (length - first) * sizeof(T));
+    }
+    static void copyOut(const T* ring, size_t position, T* dst, size_t length) {
+        size_t offset = position & (Capacity - 1);
+        size_t first = min(length, Capacity - offset);
+        memcpy(dst, ring + offset, first * sizeof(T));
+        memcpy(dst + first, ring, (length - first) * sizeof(T));
+    }
+public:
+    static constexpr size_t capacity = Capacity;
+
+    // Писатель. Что не влезло - отбрасываем (новые элементы), возвращает сколько записали
+    size_t push(const T* src, size_t length) {
+        size_t t = tail.load(memory_order_relaxed);
+        size_t free = Capacity - (t - head.load(memory_order_acquire));
+        size_t count = min(length, free);
+
+        copyIn(data, t, src, count);
+        tail.store(t + count, memory_order_release);
+
+        overflow += length - count;
+        return count;
+    }
+
+    // Читатель. Забирает до length элементов
+    size_t pop(T* dst, size_t length) {
+        size_t h = head.load(memory_order_relaxed);
+        size_t count = min(length, tail.load(memory_order_acquire) - h);
+
+        copyOut(data, h, dst, count);
+        head.store(h + count, memory_order_release);
+        return count;
+    }
+
+    // Читатель. Первый элемент без извлечения, false - пусто
+    bool peek(T& item) const {
+        size_t h = head.load(memory_order_relaxed);
+        if (tail.load(memory_order_acquire) == h) return false;
+        copyOut(data, h, &item, 1);
+        return true;
+    }
+
+    // Читатель. Выбрасывает все что накопилось, возвращает сколько выбросили
+    size_t clear() {
+        size_t h = head.load(memory_order_relaxed);
+        size_t t = tail.load(memory_order_acquire);
+        head.store(t, memory_order_release);
+        return t - h;
+    }
+
+    size_t size() const {
+        // Сначала head: tail читается позже и точно не меньше
+        size_t h = head.load(memory_order_acquire);
+        return tail.load(memory_order_acquire) - h;
+    }
+    bool empty() const { return size() == 0; }
+    // Писатель: сколько еще влезет
+    size_t freeSpace() const { return Capacity - size(); }
+    size_t overflowCount() const { return overflow; }
+};
+
+#endif /* SpscRingBuffer_hpp */
@@ -0,0 +1,59 @@
+//
+//  TcpTransport.hpp
+//  Parking
+//
+
+#ifndef TcpTransport_hpp
+#define TcpTransport_hpp
+
+#include <stdio.h>
+#include <string>
+#include <mutex>
+#include "ICommunication.h"
+
+using namespace std;
+
+// Общая часть TCP транспортов: неблокирующий сокет и ожидание через poll() с таймаутами в мс.
+// Адрес в формате "host:port".
+class TcpTransport: public ICommunication {
+public:
+    explicit TcpTransport(int connectTimeoutMs = 2000);
+    ~TcpTransport() override;
+    
+    bool connect(const string& address) override;
+    void disconnect() override;
+    void flush() override;
+    
+    bool isConnected() const { return socketFd != -1; }
+    
+protected:
+    int socketFd;
+    int connectTimeoutMs;
+    mutex sendMutex;
+    mutex recvMutex;
+    
+    // Пишем все байты, дожидаясь готовности сокета не дольше timeoutMs
+    bool writeAll(const uint8_t* data, size_t length, int timeoutMs);
+    // То же для нескольких кусков одним sendmsg
+    bool writeParts(const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline);
+    // Читаем что есть, ждем первый байт не дольше timeoutMs. 0 - таймаут, -1 - ошибка/закрыт
+    int readSome(uint8_t* buffer, size_t capacity, int timeoutMs);
+    // Ждем событие на сокете
+    bool waitFor(short events, int timeoutMs);
+};
+
+// Шлюз Ethernet -> RS-485 в прозрачном режиме: по сокету идут те же RTU кадры с CRC
+class RtuOverTcpTransport: public TcpTransport {
+public:
+    using TcpTransport::TcpTransport;
+    using ICommunication::sendBytes;
+    using ICommunication::sendParts;
+    using ICommunication::readBytes;
+    
+    bool sendBytes(const uint8_t* data, size_t length) override;
+    bool sendParts(const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline) override;
+    int readAvailable(uint8_t* buffer, int capacity, int timeoutMs) override;
+    bool hasLineTiming() const override { return false; }
+};
+
+#endif /* TcpTransport_hpp */
@@ -0,0 +1,100 @@
+//
+//  TimerWheel.hpp
+//  Parking
+//
+
+#ifndef TimerWheel_hpp
+#define TimerWheel_hpp
+
+#include <stdio.h>
+#include <array>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+using namespace std;
+
+// Отложенные действия (автозакрытие и пр.) для всех шлагбаумов - один поток на все таймеры.
+// Иерархическое колесо: 4 уровня по 64 ячейки, шаг tick. Уровень 0 - ближайшие 64 тика,
+// каждый следующий в 64 раза грубее; когда младшее колесо проходит круг, ячейка старшего
+// пересыпается вниз. Поставить, отменить и перенести - O(1), сколько бы таймеров ни было.
+// Точность - один tick: таймер срабатывает не раньше срока и не позже чем через tick после
+class TimerWheel {
+public:
+    using TimerId = uint64_t;   // 0 - нет таймера
+    using Task = function<void()>;
+    using Clock = chrono::steady_clock;
+
+    explicit TimerWheel(chrono::milliseconds tick = chrono::milliseconds(50));
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Свой поток. Без него колесо крутят руками через advance (симуляция)
+    void start();
+    void stop();
+
+    // task вызывается в потоке колеса, вне блокировок - можно ставить и отменять таймеры
+    TimerId schedule(chrono::milliseconds delay, Task task);
+    // false - уже сработал или отменен
+    bool cancel(TimerId id);
+    // Перенести срок на delay от сейчас (продлить или сократить). false - уже сработал или отменен
+    bool reschedule(TimerId id, chrono::milliseconds delay);
+    bool isPending(TimerId id) const;
+    size_t pending() const;
+
+    // Провернуть колесо до now и выполнить наступившие. Возвращает сколько выполнили
+    size_t advance(Clock::time_point now);
+
+private:
+    static constexpr int levels = 4;
+    static constexpr int slotBits = 6;
+    static constexpr uint64_t slots = 1 << slotBits;
+    static constexpr uint64_t slotMask = slots - 1;
+
+    struct Entry {
+        TimerId id;
+        uint64_t expiry;    // Номер тика
+        Task task;
+    };
+    using Slot = list<Entry>;
+
+    struct Location {
+        Slot* slot;
+        Slot::iterator entry;
+    };
+
+    chrono::milliseconds tick;
+    Clock::time_point origin;
+    uint64_t currentTick = 0;
+    TimerId nextId = 1;
+
+    array<array<Slot, slots>, levels> wheel;
+    unordered_map<TimerId, Location> index;
+
+    mutable mutex wheelMutex;
+    condition_variable wake;
+    thread worker;
+    atomic<bool> running{false};
+
+    // Под wheelMutex
+    uint64_t tickFor(Clock::time_point at) const;
+    uint64_t expiryFor(chrono::milliseconds delay);
+    Slot& slotFor(uint64_t expiry);
+    void place(Slot& from, Slot::iterator entry);
+    void cascade(int level);
+    void collect(uint64_t target, vector<Task>& due);
+    uint64_t nextWakeTick() const;
+
+    void workerLoop();
+};
+
+#endif /* TimerWheel_hpp */
@@ -0,0 +1,178 @@
+//
+//  WireCapture.hpp
+//  Parking
+//
+
+#ifndef WireCapture_hpp
+#define WireCapture_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include "ICommunication.h"
+#include "SpscRingBuffer.hpp"
+
+using namespace std;
+
+// Формат файла захвата:
+//   "PKCAP\0\0\2"                                    - 8 байт, магия + версия
+//   записи подряд: время(8, мкс от старта) канал(1) направление(1) длина(2) байты(длина)
+// Числа - little-endian. Версия 1 (без канала) читается как канал шлагбаума.
+namespace WireCapture {
+    enum class Direction : uint8_t {
+        Tx = 0, // Мы отправили
+        Rx = 1  // Мы получили
+    };
+
+    // Чья линия: шлагбаумы и считыватель пишутся в один файл с общим временем
+    enum class Channel : uint8_t {
+        Gate = 0,
+        Rfid = 1
+    };
+
+    constexpr uint8_t magic[8] = {'P', 'K', 'C', 'A', 'P', 0, 0, 2};
+    constexpr size_t recordHeaderSize = 8 + 1 + 1 + 2;
+
+    struct Record {
+        uint64_t timeUs;
+        Channel channel = Channel::Gate;
+        Direction direction;
+        vector<uint8_t> data;
+    };
+
+    // Весь файл в память (для replay и разбора)
+    bool load(const string& path, vector<Record>& records);
+}
+
+// Обертка над любым ICommunication: все что ушло и пришло пишется в файл.
+// I/O поток только кладет запись в кольцо (без системных вызовов и аллокаций),
+// в файл пишет отдельный поток раз в 50 мс. Пока запись не включена - просто прокси.
+class CaptureTransport: public ICommunication {
+private:
+    ICommunication* inner;
+
+    SpscRingBuffer<65536> ring;
+    // Писатель в кольцо должен быть один, а пишут двое: поток шины (шлагбаум) и reactor (RFID).
+    // Записи короткие, поэтому спин-флаг, а не мьютекс
+    atomic_flag producerBusy = ATOMIC_FLAG_INIT;
+    atomic<bool> recording;
+    atomic<size_t> recordsCount;
+    atomic<size_t> droppedCount;
+    chrono::steady_clock::time_point startedAt;
+
+    FILE* file = nullptr;
+    thread writer;
+    mutex writerMutex;
+    condition_variable writerWake;
+    bool stopping = false;
+
+    void writerLoop();
+    void drainToFile();
+public:
+    explicit CaptureTransport(ICommunication& port);
+    // Порт выбирается позже (по конфигу) - setPort до первого обмена
+    CaptureTransport();
+    ~CaptureTransport() override;
+
+    void setPort(ICommunication& port) { inner = &port; }
+
+    // Начать запись в файл (перезаписывается)
+    bool start(const string& path);
+    void stop();
+    bool isRecording() const { return recording; }
+
+    // Записать байты, прошедшие мимо этого транспорта (например, RFID из reactor)
+    void record(WireCapture::Channel channel, WireCapture::Direction direction, const uint8_t* data, size_t length,
+                chrono::steady_clock::time_point at = chrono::steady_clock::now());
+
+    size_t recordedCount() const { return recordsCount; }
+    // Не влезли в кольцо - файл не успевает
+    size_t droppedRecordsCount() const { return droppedCount; }
+
+    bool connect(const string& address) override { return inner->connect(address); }
+    void disconnect() override { inner->disconnect(); }
+    void flush() override { inner->flush(); }
+    // Пока порта нет - как у линии (ModbusBusMaster спрашивает еще в конструкторе)
+    bool hasLineTiming() const override { return inner ? inner->hasLineTiming() : true; }
+    bool sendBytes(const uint8_t* data, size_t length) override;
+    int readAvailable(uint8_t* buffer, int capacity, int timeoutMs) override;
+    // Время прихода от порта - и в запись, и вызывающему
+    int readChunk(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt) override;
+};
+
+// Транспорт, который проигрывает захват: отдает записанные ответы (Rx) своего канала
+// с записанными задержками, ускоренными в speed раз (0 - без задержек).
+// Задержка ответа считается от нашей отправки, поэтому тайминги запрос-ответ сохраняются.
+// Запрос сверяется с записанным, расхождения считаются.
+class ReplayTransport: public ICommunication {
+private:
+    WireCapture::Channel channel;
+    vector<WireCapture::Record> records;
+    size_t cursor = 0;
+    size_t rxOffset = 0;
+    double speed;
+
+    // Точка отсчета: записанное время и когда это было у нас
+    uint64_t anchorUs = 0;
+    chrono::steady_clock::time_point anchorTime;
+    size_t mismatches = 0;
+    size_t skippedReplies = 0;
+
+    chrono::steady_clock::time_point dueTime(const WireCapture::Record& record) const;
+public:
+    explicit ReplayTransport(double speedFactor = 1.0, WireCapture::Channel recordedChannel = WireCapture::Channel::Gate)
+        : channel(recordedChannel), speed(speedFactor) {}
+
+    // address - путь к файлу захвата
+    bool connect(const string& address) override;
+    void disconnect() override { records.clear(); cursor = 0; }
+    // Проиграть загруженный захват заново
+    void rewind();
+    void flush() override {}
+    bool sendBytes(const uint8_t* data, size_t length) override;
+    // 0 - ответ еще не пора отдавать, -1 - захват закончился
+    int readAvailable(uint8_t* buffer, int capacity, int timeoutMs) override;
+
+    // Следующий записанный запрос - чтобы повторить сессию как она была. nullptr - запросов больше нет
+    const vector<uint8_t>* nextRequest() const;
+
+    bool finished() const { return cursor >= records.size(); }
+    size_t mismatchCount() const { return mismatches; }
+    size_t skippedRepliesCount() const { return skippedReplies; }
+};
+
+// Принятые байты одного канала захвата в записанные моменты (ускоренные в speed раз, 0 - сразу все).
+// Своего потока нет: кто-то (таймер reactor) зовет playDue, и тот отдает все, чему пора.
+// В режиме replay так RFID из файла доходит до RfidReader::feed в потоке reactor, как со считывателя,
+// а шлагбаум отвечает через ReplayTransport того же файла
+class CapturePlayer {
+public:
+    using Sink = function<void(const uint8_t* data, size_t length)>;
+
+    explicit CapturePlayer(WireCapture::Channel recordedChannel, double speedFactor = 1.0)
+        : channel(recordedChannel), speed(speedFactor) {}
+
+    bool load(const string& path);
+    // Время записи отсчитывается от этого момента
+    void rewind();
+    // Отдать в sink все записи, чье время подошло. Возвращает сколько отдали
+    size_t playDue(const Sink& sink);
+
+    bool finished() const { return cursor >= records.size(); }
+    size_t size() const { return records.size(); }
+
+private:
+    WireCapture::Channel channel;
+    double speed;
+    vector<WireCapture::Record> records;
+    size_t cursor = 0;
+    chrono::steady_clock::time_point startedAt;
+};
+
+#endif /* WireCapture_hpp */
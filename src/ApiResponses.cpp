@@ -0,0 +1,132 @@
+//
+//  ApiResponses.cpp
+//  Parking
+//
+
+#include "ApiResponses.hpp"
+#include <ctime>
+
+using namespace std;
+using json = nlohmann::json;
+
+json ApiResponses::status(const GateState& state, int deviceId) {
+    json response;
+    response["device_id"] = deviceId;
+    response["status"] = state.isOpen ? "open" : "closed";
+    response["timestamp"] = time(nullptr);
+    
+    if (state.position >= 0) {
+        response["position"] = state.position;
+    } else {
+        response["position"] = nullptr;
+    }
+    
+    if (state.exceptionCode != 0) {
+        response["error"] = ModbusException::describe(state.exceptionCode);
+    }
+    return response;
+}
+
+json ApiResponses::status(const GateSnapshot& snapshot, int deviceId, bool stale) {
+    json response = status(snapshot.state, deviceId);
+    response["phase"] = gatePhaseName(snapshot.phase);
+    if (snapshot.polls > 0) {
+        response["age_ms"] = snapshot.age().count();
+    } else {
+        response["age_ms"] = nullptr;
+    }
+    response["stale"] = stale;
+    if (snapshot.vehicleSensor) {
+        response["vehicle_present"] = snapshot.state.vehiclePresent;
+    }
+    return response;
+}
+
+json ApiResponses::accepted() {
+    json response;
+    response["ok"] = true;
+    response["status"] = "accepted";
+    return response;
+}
+
+json ApiResponses::commandResult(const GateCommandResult& result) {
+    json response;
+    response["ok"] = result.ok();
+    response["command"] = gateCommandName(result.command);
+    response["status"] = gateCommandOutcomeName(result.outcome);
+    response["phase"] = gatePhaseName(result.phase);
+    response["queued_ms"] = result.queued.count();
+    response["elapsed_ms"] = result.elapsed.count();
+    if (!result.error.empty()) {
+        response["message"] = result.error;
+    }
+    return response;
+}
+
+json ApiResponses::busy(size_t depth) {
+    json response;
+    response["ok"] = false;
+    response["status"] = "busy";
+    response["depth"] = depth;
+    response["message"] = "Очередь команд шлагбаума переполнена, повторите позже";
+    return response;
+}
+
+json ApiResponses::groupResult(const GateGroupResult& result) {
+    json response;
+    response["ok"] = result.ok;
+    response["command"] = gateCommandName(result.command);
+    response["broadcast"] = result.broadcast;
+    response["members"] = result.members;
+    response["reached"] = result.reached;
+    json phases = json::array();
+    for (GatePhase phase : result.phases) {
+        phases.push_back(gatePhaseName(phase));
+    }
+    response["phases"] = phases;
+    response["elapsed_ms"] = result.elapsed.count();
+    if (!result.error.empty()) {
+        response["message"] = result.error;
+    }
+    return response;
+}
+
+json ApiResponses::groupBusy() {
+    json response;
+    response["ok"] = false;
+    response["status"] = "busy";
+    response["message"] = "Группа еще выполняет прошлую команду, повторите позже";
+    return response;
+}
+
+json ApiResponses::noGroup() {
+    json response;
+    response["ok"] = false;
+    response["message"] = "Группа шлагбаумов не настроена";
+    return response;
+}
+
+json ApiResponses::laneMetrics(const LaneStats& stats, bool convoy) {
+    json response;
+    response["vehicles_per_minute"] = stats.vehiclesPerMinute;
+    response["vehicles"] = stats.vehicles;
+    response["cycles"] = stats.cycles;
+    response["average_cycle_ms"] = stats.averageCycle.count();
+    response["vehicles_per_cycle"] = stats.vehiclesPerCycle;
+    response["convoy"] = convoy;
+    return response;
+}
+
+json ApiResponses::unauthorized() {
+    json response;
+    response["ok"] = false;
+    return response;
+}
+
+json ApiResponses::event(const string& eventType, const json& data) {
+    json payload;
+    payload["event"] = eventType;
+    payload["data"] = data;
+    payload["timestamp"] = time(nullptr);
+    return payload;
+}
@@ -0,0 +1,136 @@
+//
+//  BarrierModel.cpp
+//  Parking
+//
+
+#include "BarrierModel.hpp"
+#include "ModbusUtils.hpp"
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+BarrierModel::BarrierModel(uint8_t id, int travelTimeMs)
+    : slaveId(id), percentPerMs(100.0 / max(travelTimeMs, 1)) {}
+
+void BarrierModel::update(Clock::time_point now) {
+    if (!started) {
+        lastUpdate = now;
+        started = true;
+        return;
+    }
+    
+    double elapsedMs = chrono::duration<double, milli>(now - lastUpdate).count();
+    lastUpdate = now;
+    if (elapsedMs <= 0) return;
+    
+    double step = elapsedMs * percentPerMs;
+    if (openCommand) {
+        positionPercent = min(100.0, positionPercent + step);
+    } else {
+        positionPercent = max(0.0, positionPercent - step);
+    }
+}
+
+bool BarrierModel::discreteInput(uint16_t address) const {
+    switch (address) {
+        case 1: return isClosed();
+        case 2: return isOpen();
+        case 3: return vehicle;
+        default: return false;
+    }
+}
+
+size_t BarrierModel::exception(uint8_t function, uint8_t code, uint8_t* reply) const {
+    reply[0] = function | 0x80;
+    reply[1] = code;
+    return 2;
+}
+
+size_t BarrierModel::handlePdu(const uint8_t* pdu, size_t length, uint8_t* reply, Clock::time_point now) {
+    update(now);
+    
+    if (length < 1) return 0;
+    uint8_t function = pdu[0];
+    
+    // Все поддерживаемые запросы: FC + Адрес(2) + Значение/Кол-во(2)
+    if (length < 5) return exception(function, 0x03, reply);
+    
+    uint16_t address = (pdu[1] << 8) | pdu[2];
+    uint16_t value = (pdu[3] << 8) | pdu[4];
+    
+    switch (function) {
+        case 0x01: // Read Coils
+        case 0x02: { // Read Discrete Inputs
+            if (value == 0 || value > 2000) return exception(function, 0x03, reply);
+            
+            size_t byteCount = (value + 7) / 8;
+            reply[0] = function;
+            reply[1] = static_cast<uint8_t>(byteCount);
+            memset(reply + 2, 0, byteCount);
+            
+            for (uint16_t i = 0; i < value; i++) {
+                bool bit = function == 0x01 ? (address + i == 0 && openCommand) : discreteInput(address + i);
+                if (bit) reply[2 + i / 8] |= (1 << (i % 8));
+            }
+            return 2 + byteCount;
+        }
+        case 0x04: { // Read Input Registers
+            if (value == 0 || value > 125) return exception(function, 0x03, reply);
+            
+            reply[0] = function;
+            reply[1] = static_cast<uint8_t>(value * 2);
+            for (uint16_t i = 0; i < value; i++) {
+                uint16_t reg = (address + i == 0) ? static_cast<uint16_t>(position()) : 0;
+                reply[2 + i * 2] = (reg >> 8) & 0xFF;
+                reply[3 + i * 2] = reg & 0xFF;
+            }
+            return 2 + value * 2;
+        }
+        case 0x05: { // Write Single Coil
+            if (address != 0) return exception(function, 0x02, reply);
+            if (value != 0xFF00 && value != 0x0000) return exception(function, 0x03, reply);
+            
+            openCommand = (value == 0xFF00);
+            memcpy(reply, pdu, 5);
+            return 5;
+        }
+        case 0x0F: { // Write Multiple Coils
+            if (length < 6) return exception(function, 0x03, reply);
+            
+            size_t byteCount = pdu[5];
+            if (value == 0 || value > 1968 || byteCount != (value + 7u) / 8 || length < 6 + byteCount) {
+                return exception(function, 0x03, reply);
+            }
+            
+            // Нас интересует только Coil[0]
+            if (address == 0) {
+                openCommand = (pdu[6] & 0x01) != 0;
+            }
+            memcpy(reply, pdu, 5);
+            return 5;
+        }
+        default:
+            return exception(function, 0x01, reply);
+    }
+}
+
+size_t BarrierModel::handleRtu(const uint8_t* frame, size_t length, uint8_t* reply, Clock::time_point now) {
+    if (length < 4) return 0;
+    
+    // Broadcast выполняем молча. Slave с ID 0 (как в fake_barrier.py) отвечает на 0 как на свой адрес
+    if (frame[0] == ModbusBroadcastAddress && slaveId != ModbusBroadcastAddress) {
+        handlePdu(frame + 1, length - 3, reply + 1, now);
+        return 0;
+    }
+    if (frame[0] != slaveId) return 0;
+    
+    size_t pduLength = handlePdu(frame + 1, length - 3, reply + 1, now);
+    if (pduLength == 0) return 0;
+    
+    reply[0] = slaveId;
+    uint16_t crc = ModbusUtils::calculateCRC(reply, pduLength + 1);
+    reply[pduLength + 1] = crc & 0xFF;
+    reply[pduLength + 2] = (crc >> 8) & 0xFF;
+    return pduLength + 3;
+}
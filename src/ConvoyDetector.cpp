@@ -0,0 +1,46 @@
+//
+//  ConvoyDetector.cpp
+//  Parking
+//
+
+#include "ConvoyDetector.hpp"
+
+using namespace std;
+
+void ConvoyDetector::configure(const ConvoySettings& convoySettings) {
+    config = convoySettings;
+    // Порог выхода не задан - половина порога входа
+    if (config.exitPerMinute <= 0 || config.exitPerMinute > config.enterPerMinute) {
+        config.exitPerMinute = config.enterPerMinute / 2;
+    }
+    arrivals.clear();
+    convoy = false;
+}
+
+void ConvoyDetector::trim(Clock::time_point now) {
+    while (!arrivals.empty() && now - arrivals.front() > config.window) {
+        arrivals.pop_front();
+    }
+}
+
+double ConvoyDetector::ratePerMinute() const {
+    double minutes = chrono::duration<double, ratio<60>>(config.window).count();
+    return minutes > 0 ? arrivals.size() / minutes : 0;
+}
+
+bool ConvoyDetector::arrival(Clock::time_point now) {
+    if (!config.enabled()) return false;
+    arrivals.push_back(now);
+    return update(now);
+}
+
+bool ConvoyDetector::update(Clock::time_point now) {
+    if (!config.enabled()) return false;
+    trim(now);
+
+    double rate = ratePerMinute();
+    bool next = convoy ? rate >= config.exitPerMinute : rate >= config.enterPerMinute;
+    if (next == convoy) return false;
+    convoy = next;
+    return true;
+}
@@ -0,0 +1,79 @@
+//
+//  FdWriter.cpp
+//  Parking
+//
+
+#include "FdWriter.hpp"
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+// На macOS нет MSG_NOSIGNAL, там SIGPIPE отключается опцией сокета (TcpTransport::connect)
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+
+bool FdWriter::writeParts(int fd, const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline, bool socket) {
+    if (fd == -1) return false;
+
+    // Позиция: текущий кусок и сколько из него уже ушло
+    size_t index = 0;
+    size_t offset = 0;
+
+    while (true) {
+        while (index < count && offset >= parts[index].length) {
+            index++;
+            offset = 0;
+        }
+        if (index == count) return true;
+
+        iovec iov[maxPartsPerCall];
+        int iovCount = 0;
+        for (size_t i = index; i < count && iovCount < maxPartsPerCall; i++) {
+            size_t skip = (i == index) ? offset : 0;
+            iov[iovCount].iov_base = const_cast<uint8_t*>(parts[i].data + skip);
+            iov[iovCount].iov_len = parts[i].length - skip;
+            iovCount++;
+        }
+
+        ssize_t written;
+        if (socket) {
+            msghdr message = {};
+            message.msg_iov = iov;
+            message.msg_iovlen = iovCount;
+            written = sendmsg(fd, &message, MSG_NOSIGNAL);
+        } else {
+            written = writev(fd, iov, iovCount);
+        }
+
+        if (written > 0) {
+            // Короткая запись - сдвигаемся на записанное и пишем остаток
+            size_t left = static_cast<size_t>(written);
+            while (left > 0) {
+                size_t step = min(left, parts[index].length - offset);
+                offset += step;
+                left -= step;
+                if (offset == parts[index].length) {
+                    index++;
+                    offset = 0;
+                }
+            }
+            continue;
+        }
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return false;
+
+        // Буфер драйвера полон - ждем пока освободится, но не дольше дедлайна
+        auto remaining = chrono::ceil<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        if (remaining <= 0) return false;
+
+        pollfd pfd = {fd, POLLOUT, 0};
+        int rc = poll(&pfd, 1, static_cast<int>(remaining));
+        if (rc < 0 && errno != EINTR) return false;
+        if (rc > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) return false;
+    }
+}
@@ -0,0 +1,410 @@
+//
+//  GateCommandQueue.cpp
+//  Parking
+//
+
+#include "GateCommandQueue.hpp"
+#include <iostream>
+
+using namespace std;
+
+const char* gateCommandName(GateCommand command) {
+    return command == GateCommand::Open ? "open" : "close";
+}
+
+const char* gateCommandOutcomeName(GateCommandOutcome outcome) {
+    switch (outcome) {
+        case GateCommandOutcome::Done: return "done";
+        case GateCommandOutcome::Failed: return "failed";
+        case GateCommandOutcome::Coalesced: return "coalesced";
+        case GateCommandOutcome::Rejected: return "rejected";
+        case GateCommandOutcome::Cancelled: return "cancelled";
+    }
+    return "failed";
+}
+
+GateCommandQueue::GateCommandQueue(GateController& gateController, size_t depth) : controller(gateController), maxDepth(depth) {
+}
+
+GateCommandQueue::~GateCommandQueue() {
+    cancelAutoClose();
+    stop();
+}
+
+void GateCommandQueue::setAutoClose(TimerWheel& wheel, chrono::milliseconds hold) {
+    lock_guard<mutex> lock(autoCloseMutex);
+    timers = &wheel;
+    holdOpen = hold;
+}
+
+void GateCommandQueue::setVehicleClose(chrono::milliseconds afterClear) {
+    {
+        lock_guard<mutex> lock(autoCloseMutex);
+        clearDelay = afterClear;
+    }
+    controller.states().addVehicleListener([this](bool present) { vehicleChanged(present); });
+}
+
+void GateCommandQueue::setConvoy(const ConvoySettings& settings) {
+    lock_guard<mutex> lock(autoCloseMutex);
+    convoy.configure(settings);
+}
+
+bool GateCommandQueue::convoyActive() const {
+    lock_guard<mutex> lock(autoCloseMutex);
+    return convoy.active();
+}
+
+chrono::milliseconds GateCommandQueue::currentHold() const {
+    return convoy.active() ? max(holdOpen, convoy.settings().hold) : holdOpen;
+}
+
+void GateCommandQueue::convoyChanged() {
+    // Открытый шлагбаум с датчиком опрашивается часто ради быстрого закрытия - в колонне реже
+    if (convoy.settings().vehiclePoll > chrono::milliseconds(0)) {
+        GateStateMachine::Timing timing = controller.states().timing();
+        if (convoy.active()) {
+            normalVehiclePoll = timing.vehiclePoll;
+            timing.vehiclePoll = convoy.settings().vehiclePoll;
+        } else {
+            timing.vehiclePoll = normalVehiclePoll;
+        }
+        controller.states().setTiming(timing);
+    }
+
+    if (convoy.active()) {
+        convoyActivations++;
+        cout << "[Commands] Колонна: " << convoy.ratePerMinute() << " машин/мин, держим открытым "
+             << currentHold().count() << " мс после последней\n";
+    } else {
+        cout << "[Commands] Колонна закончилась, " << convoy.ratePerMinute() << " машин/мин\n";
+    }
+}
+
+void GateCommandQueue::noteArrival() {
+    lock_guard<mutex> lock(autoCloseMutex);
+    if (convoy.arrival(chrono::steady_clock::now())) convoyChanged();
+    if (convoy.active()) convoyArrivals++;
+}
+
+void GateCommandQueue::vehicleChanged(bool present) {
+    lock_guard<mutex> lock(autoCloseMutex);
+    vehicleInLane = present;
+    if (present || autoCloseTimer == 0) return;
+
+    // В колонне за машиной не закрываем - следующая уже едет. Ждем ее hold от момента проезда
+    if (convoy.active()) {
+        timers->reschedule(autoCloseTimer, currentHold());
+        closeOnClear = false;
+        return;
+    }
+    if (clearDelay <= chrono::milliseconds(0)) return;
+
+    // Проехал - остаток timeout_open_gate не ждем
+    if (timers->reschedule(autoCloseTimer, clearDelay)) {
+        closeOnClear = true;
+        cout << "[Commands] Машина проехала, закрытие через " << clearDelay.count() << " мс\n";
+    }
+}
+
+void GateCommandQueue::armAutoClose() {
+    lock_guard<mutex> lock(autoCloseMutex);
+    if (!timers) return;
+    chrono::milliseconds hold = currentHold();
+
+    // Новый проезд разрешен - снова ждем его полное время, даже если предыдущий уже проехал
+    closeOnClear = false;
+
+    // Еще не сработал - просто сдвигаем срок, второго закрытия не будет
+    if (autoCloseTimer != 0 && timers->reschedule(autoCloseTimer, hold)) {
+        autoCloseExtended++;
+        cout << "[Commands] Автозакрытие продлено на " << hold.count() << " мс\n";
+        return;
+    }
+
+    uint64_t generation = ++autoCloseGeneration;
+    autoCloseTimer = timers->schedule(hold, [this, generation]() { fireAutoClose(generation); });
+    cout << "[Commands] Автозакрытие через " << hold.count() << " мс\n";
+}
+
+void GateCommandQueue::cancelAutoClose() {
+    lock_guard<mutex> lock(autoCloseMutex);
+    if (autoCloseTimer == 0) return;
+
+    timers->cancel(autoCloseTimer);
+    autoCloseTimer = 0;
+    autoCloseGeneration++;
+    closeOnClear = false;
+}
+
+void GateCommandQueue::fireAutoClose(uint64_t generation) {
+    {
+        lock_guard<mutex> lock(autoCloseMutex);
+        // Пока таймер разбирали, его сняли или поставили заново
+        if (generation != autoCloseGeneration || autoCloseTimer == 0) return;
+
+        // На машину не закрываем: ждем, пока освободит датчик (он переставит таймер на clearDelay),
+        // а на случай залипшего датчика - еще один полный срок
+        if (vehicleInLane) {
+            autoCloseTimer = timers->schedule(holdOpen, [this, generation]() { fireAutoClose(generation); });
+            closeDeferred++;
+            cout << "[Commands] В створе машина, закрытие отложено\n";
+            return;
+        }
+        autoCloseTimer = 0;
+        if (closeOnClear) vehicleCloses++;
+        closeOnClear = false;
+
+        // Машин за hold не было - закрываем; заодно темп за окно мог упасть ниже порога
+        if (convoy.update(chrono::steady_clock::now())) convoyChanged();
+    }
+
+    autoCloses++;
+    // Таймер уже снят: откажи очередь по глубине - шлагбаум остался бы открытым без таймера.
+    // Поэтому автозакрытие идет в запасное место сверх maxDepth
+    enqueue(GateCommand::Close, [](const GateCommandResult& result) {
+        if (!result.ok()) {
+            cerr << "[Commands] Автозакрытие не удалось: " << result.error << "\n";
+        }
+    }, false, true);
+}
+
+bool GateCommandQueue::autoClosePending() const {
+    lock_guard<mutex> lock(autoCloseMutex);
+    return autoCloseTimer != 0;
+}
+
+void GateCommandQueue::start() {
+    if (running) return;
+    running = true;
+    worker = thread([this]() { workerLoop(); });
+}
+
+void GateCommandQueue::stop() {
+    if (!running) return;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    // Что не успели - отменяем, чтобы никто не ждал вечно
+    deque<Pending> left;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        left.swap(pending);
+    }
+    for (auto& job : left) {
+        GateCommandResult result;
+        result.command = job.command;
+        result.outcome = GateCommandOutcome::Cancelled;
+        result.phase = controller.phase();
+        complete(job.waiters, result);
+    }
+}
+
+bool GateCommandQueue::submit(GateCommand command, Completion done, bool autoClose) {
+    return enqueue(command, move(done), autoClose, false);
+}
+
+bool GateCommandQueue::enqueue(GateCommand command, Completion done, bool autoClose, bool reserved) {
+    GateCommandResult immediate;
+    immediate.command = command;
+
+    // Закрываем - ждать таймера больше нечего
+    if (command == GateCommand::Close) {
+        cancelAutoClose();
+    } else if (autoClose) {
+        noteArrival();
+    }
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+
+        // Такая же последней в очереди - ждем ее исхода, новой команды не надо
+        if (!pending.empty() && pending.back().command == command) {
+            pending.back().autoClose |= autoClose;
+            pending.back().waiters.push_back(move(done));
+            counters.coalesced++;
+            return true;
+        }
+
+        if (pending.empty()) {
+            // Такая же уже на шине - ждем ее исхода
+            if (busy && active.command == command) {
+                active.autoClose |= autoClose;
+                active.waiters.push_back(move(done));
+                counters.coalesced++;
+                return true;
+            }
+
+            // Шлагбаум уже там или едет туда - команда ничего не изменит
+            GatePhase phase = controller.phase();
+            bool already = command == GateCommand::Open
+                ? (phase == GatePhase::Open || phase == GatePhase::Opening)
+                : (phase == GatePhase::Closed || phase == GatePhase::Closing);
+            if (!busy && already) {
+                counters.coalesced++;
+                immediate.outcome = GateCommandOutcome::Coalesced;
+                immediate.phase = phase;
+            }
+        }
+
+        if (immediate.outcome != GateCommandOutcome::Coalesced) {
+            if (!running || pending.size() >= maxDepth + (reserved ? 1 : 0)) {
+                counters.rejected++;
+                immediate.outcome = GateCommandOutcome::Rejected;
+                immediate.phase = controller.phase();
+                immediate.error = running ? "Очередь команд переполнена" : "Очередь команд остановлена";
+            } else {
+                Pending job;
+                job.command = command;
+                job.autoClose = autoClose;
+                job.queuedAt = chrono::steady_clock::now();
+                job.waiters.push_back(move(done));
+                pending.push_back(move(job));
+                counters.maxDepth = max(counters.maxDepth, pending.size());
+                wake.notify_one();
+                return true;
+            }
+        }
+    }
+
+    // Уже открыт или открывается, а проезд новый - держим открытым дольше, команду не шлем
+    if (immediate.outcome == GateCommandOutcome::Coalesced && command == GateCommand::Open && autoClose) {
+        armAutoClose();
+    }
+
+    // Склеили с состоянием или отказали - отвечаем сразу, вне блокировки
+    if (done) done(immediate);
+    return immediate.outcome != GateCommandOutcome::Rejected;
+}
+
+future<GateCommandResult> GateCommandQueue::submitAsync(GateCommand command, bool autoClose) {
+    auto promised = make_shared<promise<GateCommandResult>>();
+    future<GateCommandResult> result = promised->get_future();
+    submit(command, [promised](const GateCommandResult& outcome) { promised->set_value(outcome); }, autoClose);
+    return result;
+}
+
+void GateCommandQueue::supersede(GateCommand command) {
+    cancelAutoClose();
+
+    deque<Pending> dropped;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        // Выполняемая не поставит таймер, когда доедет
+        if (busy) active.autoClose = false;
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (it->command != command) {
+                dropped.push_back(move(*it));
+                it = pending.erase(it);
+            } else {
+                it->autoClose = false;
+                ++it;
+            }
+        }
+        counters.superseded += dropped.size();
+    }
+
+    for (auto& job : dropped) {
+        GateCommandResult result;
+        result.command = job.command;
+        result.outcome = GateCommandOutcome::Cancelled;
+        result.phase = controller.phase();
+        result.error = "Перекрыта групповой командой";
+        complete(job.waiters, result);
+    }
+}
+
+size_t GateCommandQueue::depth() const {
+    lock_guard<mutex> lock(queueMutex);
+    return pending.size() + (busy ? 1 : 0);
+}
+
+GateCommandStats GateCommandQueue::stats() const {
+    lock_guard<mutex> lock(queueMutex);
+    GateCommandStats result = counters;
+    result.autoCloses = autoCloses;
+    result.autoCloseExtended = autoCloseExtended;
+    result.vehicleCloses = vehicleCloses;
+    result.closeDeferred = closeDeferred;
+    result.convoyActivations = convoyActivations;
+    result.convoyArrivals = convoyArrivals;
+    return result;
+}
+
+void GateCommandQueue::complete(vector<Completion>& waiters, const GateCommandResult& result) {
+    for (auto& done : waiters) {
+        if (done) done(result);
+    }
+}
+
+GateCommandResult GateCommandQueue::execute(const Pending& job) {
+    GateCommandResult result;
+    result.command = job.command;
+
+    auto startedAt = chrono::steady_clock::now();
+    result.queued = chrono::duration_cast<chrono::milliseconds>(startedAt - job.queuedAt);
+
+    try {
+        if (job.command == GateCommand::Open) {
+            controller.openGate();
+        } else {
+            controller.closeGate();
+        }
+    } catch (const exception& e) {
+        result.error = e.what();
+    }
+
+    // openGate/closeGate ждут концевика сами, исход - по фазе, в которой закончили
+    result.phase = controller.phase();
+    GatePhase target = job.command == GateCommand::Open ? GatePhase::Open : GatePhase::Closed;
+    if (result.error.empty() && result.phase == target) {
+        result.outcome = GateCommandOutcome::Done;
+    } else {
+        result.outcome = GateCommandOutcome::Failed;
+        if (result.error.empty()) result.error = string("Не доехал, фаза ") + gatePhaseName(result.phase);
+    }
+    result.elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startedAt);
+    return result;
+}
+
+void GateCommandQueue::workerLoop() {
+    while (true) {
+        unique_lock<mutex> lock(queueMutex);
+        wake.wait(lock, [this]() { return !pending.empty() || !running; });
+        if (!running) break;
+
+        active = move(pending.front());
+        pending.pop_front();
+        busy = true;
+        // Ждущие остаются в active - к ним можно присоединиться, пока едем
+        Pending job;
+        job.command = active.command;
+        job.queuedAt = active.queuedAt;
+        lock.unlock();
+
+        GateCommandResult result = execute(job);
+
+        lock.lock();
+        // autoClose мог добавить присоединившийся во время хода
+        bool autoClose = active.autoClose;
+        vector<Completion> waiters = move(active.waiters);
+        active.waiters.clear();
+        busy = false;
+        counters.executed++;
+        if (result.outcome == GateCommandOutcome::Failed) counters.failed++;
+        lock.unlock();
+
+        if (result.outcome == GateCommandOutcome::Failed) {
+            cerr << "[Commands] " << gateCommandName(result.command) << ": " << result.error << "\n";
+        } else if (result.command == GateCommand::Open && autoClose) {
+            armAutoClose();
+        }
+        complete(waiters, result);
+    }
+}
@@ -11,77 +11,92 @@
 #include <unistd.h>
 #include <thread>
 #include <stdexcept>
-#include "ConfigLoader.hpp"
+#include <cstring>
 
 using namespace std;
 
-void GateController::openGate(bool autoClose) {
-    port.flush();
-    cout << "[Controller] Отправили команду на открытие\n";
+int GateController::transaction(const ModbusFrame::Buffer& request, uint8_t* reply, size_t capacity, int timeoutMs) {
+    // Все что лежало в порту до отправки - не наше, transact это выбросит
+    ModbusRtuFramer framer(baudRate);
+    framer.setGapDetection(port.hasLineTiming());
+    
+    int replyLength = noReply;
+    auto collect = [&](const uint8_t* data, size_t length, chrono::steady_clock::time_point arrivedAt) {
+        // Пауза между порциями - по времени прихода, а не разбора
+        framer.feed(data, length, arrivedAt);
+        
+        ModbusRtuFrame received;
+        while (framer.nextFrame(received)) {
+            // Ответ от нашего устройства на нашу команду (или исключение по ней)
+            if (received.address() == request[0] && (received.function() & 0x7F) == request[1]) {
+                if (received.length <= capacity) {
+                    memcpy(reply, received.data, received.length);
+                    replyLength = static_cast<int>(received.length);
+                }
+                return true;
+            }
+            staleFrames++;
+        }
+        return false;
+    };
+    
+    // Шина занята от отправки до ответа, /status, мониторинг и автозакрытие ждут по очереди.
+    // За очередью шины следит она сама, timeoutMs - окно на ответ
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    TransactResult result = port.transact(request.data(), request.size(), ReplySpec::from(collect), deadline);
     
-    ModbusFrame frame = { deviceId, Command::WRITE_SINGL_COIL, 0x0000, Action::OPEN };
-    auto rawData = frame.serialize();
+    garbageBytes += framer.garbageCount() + framer.pending();
+    if (result == TransactResult::NotSent) return notSent;
+    return replyLength;
+}
 
-    port.sendBytes(rawData);
+void GateController::throwIfException(const uint8_t* reply, int length) {
+    if (length < 0 || !ModbusException::isException(reply, length)) return;
     
-    // по стандарту modbus, устройство должно прислать ответ (ACK)
-    vector<uint8_t> response;
-    int bytesRead = port.readBytes(response, 8, 2); // Ждем 8 байт, 2 секунды
+    ModbusException error(reply[0], reply[1] & 0x7F, reply[2]);
+    log("Error", error.what());
+    throw error;
+}
 
-    // Проверяем что вернулось 8 байт
-    if (bytesRead != 8) {
+CommandDelivery GateController::sendCommand(bool open) {
+    // по стандарту modbus, устройство должно прислать ответ (ACK), CRC уже проверен фреймером
+    array<uint8_t, 8> response;
+    const ModbusFrame::Buffer& request = open ? OpenGateFrame::forSlave(deviceId) : CloseGateFrame::forSlave(deviceId);
+    int bytesRead = transaction(request, response.data(), response.size(), replyTimeoutMs);
+    // Отказ приходит за 5 байт, сразу пробрасываем его, а не ждем таймаут
+    throwIfException(response.data(), bytesRead);
+    
+    // Запрос до slave не дошел - в автомат нечего записывать
+    if (bytesRead == notSent) return CommandDelivery::NotSent;
+    
+    // Эхо команды - 8 байт
+    if (bytesRead != 8) return CommandDelivery::NoEcho;
+    markCommandSent(open);
+    return CommandDelivery::Echoed;
+}
+
+void GateController::openGate() {
+    cout << "[Controller] Отправили команду на открытие\n";
+    
+    // Проверяем что вернулось эхо команды
+    if (sendCommand(true) != CommandDelivery::Echoed) {
         log("Error", "Ошибка, с ответом от шлагбаума что то не так");
         throw runtime_error("Ошибка, с ответом от шлагбаума что то не так");
-        return;
     }
 
-    // Проверяем СRС ответа, нужно что бы они совпадали
-    uint16_t receivedCRC = response[6] | (response[7] << 8);
-    vector<uint8_t> dataOnly(response.begin(), response.end() - 2);
-    uint16_t calcCRC = ModbusUtils::calculateCRC(dataOnly);
-
-    if (receivedCRC == calcCRC) {
-        log("Controller", "CRC совпадают. Шлагбаум начал открываться");
-        waitForOpen();
+    log("Controller", "Шлагбаум начал открываться");
+    if (waitForOpen()) {
         log("Controller", "Шлагбаум открыт");
-        
-        // Логика для автозакрытия
-        if (autoClose) {
-            thread t([this]() {
-                // Загружаем конфиг
-                string pathConfig = "/Users/mvc/Documents/C++/SysCalls/Parking/config.txt";
-                ConfigLoader config;
-                if (!config.load(pathConfig)) {
-                    cout << "Файл не найден\n";
-                }
-                //
-                int timeout = config.getInt("timeout_open_gate");
-                
-                log("INFO", "Запущен таймер автозакрытия");
-                
-                this_thread::sleep_for(chrono::seconds(timeout));
-                this->closeGate();
-            });
-            t.detach();
-            
-        }
-        
     } else {
-        log("Error", "CRC не совпали");
-        throw runtime_error("CRC не совпали");
+        log("Error", string("Шлагбаум не открылся, фаза ") + gatePhaseName(stateMachine.phase()));
     }
 }
 
 bool GateController::isGateOpen() {
-    port.flush();
     // Адрес DI2 0x0002 (на открытие)
-    ModbusFrame frame = { deviceId, Command::READ_DSSCRETE_INPUTS, 0x0002, Action::SINGLE };
-    auto rawData = frame.serialize();
-    
-    if (!port.sendBytes(rawData)) return false;
-    
-    vector<uint8_t> response;
-    int bytesRead = port.readBytes(response, 6, 2); // Ждем 6 байт, 2 секунды
+    array<uint8_t, 6> response;
+    int bytesRead = transaction(ReadOpenedFrame::forSlave(deviceId), response.data(), response.size(), replyTimeoutMs);
+    throwIfException(response.data(), bytesRead);
     
     if (bytesRead != 6) {
         return  false;
@@ -106,73 +121,105 @@ bool GateController::isGateOpen() {
     return isOpen;
 }
 
-void GateController::waitForOpen() {
-    int timeoutSeconds = 10;
-    
-    auto startTime = chrono::steady_clock::now();
-    
-    while (true) {
-        
-        if (GateController::isGateOpen()) {
-            cout << "[Polling] Шлагбаум открыт \n";
-            port.flush();
-            break;
-        }
-        
-        auto now = chrono::steady_clock::now();
-        if (chrono::duration_cast<chrono::seconds>(now - startTime).count() > timeoutSeconds) {
-            cout << "[Polling] Отвалились по таймауту \n";
-            break;
-        }
-        
-        this_thread::sleep_for(chrono::milliseconds(100));
-    }
+bool GateController::waitForOpen() {
+    return waitForPhase(GatePhase::Open, stateMachine.timing().travelTimeout) == GatePhase::Open;
 }
 
 void GateController::closeGate() {
-    // port.flush();
     cout << "[Controller] Отправили команду на закрытие\n";
 
-    ModbusFrame frame = { deviceId, Command::WRITE_SINGL_COIL, 0x0000, Action::CLOSE };
-    auto rawData = frame.serialize();
-    port.sendBytes(rawData);
+    // Без эха все равно ждем концевик: закрытие было на линии, мог потеряться только ответ.
+    // А если запрос не ушел вовсе, ждать нечего
+    CommandDelivery delivery = sendCommand(false);
+    if (delivery == CommandDelivery::NotSent) {
+        log("Error", "Команда на закрытие не ушла на линию");
+        throw runtime_error("Команда на закрытие не ушла на линию");
+    }
+    if (delivery == CommandDelivery::NoEcho) {
+        markCommandSent(false);
+    }
     
-    waitForClose();
-    log("Controller", "Шлагбаум закрыт");
+    if (waitForClose()) {
+        log("Controller", "Шлагбаум закрыт");
+    } else {
+        log("Error", string("Шлагбаум не закрылся, фаза ") + gatePhaseName(stateMachine.phase()));
+    }
+}
+
+bool GateController::waitForClose() {
+    return waitForPhase(GatePhase::Closed, stateMachine.timing().travelTimeout) == GatePhase::Closed;
 }
 
-void GateController::waitForClose() {
-    int timeoutSeconds = 10;
+GateState GateController::poll(const GatePollPlan& plan) {
+    GateState state;
     
-    auto startTime = chrono::steady_clock::now();
+    if (plan.readLimits) {
+        // У концевика положение уже известно, ждем только концевик - один обмен вместо двух
+        state = queryState(plan.readPosition);
+        stateMachine.observe(state, state.timestamp);
+        return state;
+    }
+    
+    // В середине хода концевики не нужны - только положение для оценки скорости
+    state.timestamp = clockNow();
+    try {
+        state.position = getGatePosition();
+        state.valid = state.position >= 0;
+    } catch (const ModbusException& e) {
+        state.exceptionCode = static_cast<uint8_t>(e.exceptionCode());
+    }
+    stateMachine.observePosition(state.position, state.timestamp);
+    return state;
+}
+
+GatePhase GateController::waitForPhase(GatePhase target, chrono::milliseconds timeout) {
+    auto deadline = clockNow() + timeout;
+    // Ждущие не опрашивают и спят на реальных часах (в симуляции поток один и всегда опрашивает сам)
+    auto waitDeadline = chrono::steady_clock::now() + timeout;
     
     while (true) {
-        if (GateController::isGateClose()) {
-            cout << "[Polling] Шлагбаум закрыт \n";
-            break;
+        GateMotion motion = stateMachine.motion();
+        if (motion.phase == target || motion.phase == GatePhase::Fault) return motion.phase;
+        if (clockNow() >= deadline) {
+            cout << "[Polling] Отвалились по таймауту, фаза " << gatePhaseName(motion.phase) << "\n";
+            return motion.phase;
         }
         
-        auto now = chrono::steady_clock::now();
-        if (chrono::duration_cast<chrono::seconds>(now - startTime).count() > timeoutSeconds) {
-            cout << "[Polling] Отвалились по таймауту \n";
-            break;
+        if (stateMachine.beginPolling()) {
+            pollUntil(target, deadline);
+        } else {
+            stateMachine.waitForChange(motion.transitions, waitDeadline);
         }
-        
-        this_thread::sleep_for(chrono::milliseconds(100));
     }
+}
+
+void GateController::pollUntil(GatePhase target, chrono::steady_clock::time_point deadline) {
+    // Опрос освобождаем при любом выходе, иначе ждущие останутся без опрашивающего
+    struct PollingGuard {
+        GateStateMachine& machine;
+        ~PollingGuard() { machine.endPolling(); }
+    } guard{stateMachine};
     
+    GatePollPlan plan = stateMachine.nextPoll(clockNow());
+    while (true) {
+        poll(plan);
+        
+        GatePhase phase = stateMachine.phase();
+        if (phase == target || phase == GatePhase::Fault) return;
+        
+        auto now = clockNow();
+        if (now >= deadline) return;
+        
+        plan = stateMachine.nextPoll(now);
+        sleepFor(min(plan.delay, chrono::ceil<chrono::milliseconds>(deadline - now)));
+    }
 }
 
 bool GateController::isGateClose() {
-    port.flush();
     // Адрес DI1 0x0001 (на закрытие)
-    ModbusFrame frame = { deviceId, Command::READ_DSSCRETE_INPUTS, 0x0001, Action::SINGLE };
-    auto rawData = frame.serialize();
-    
-    if (!port.sendBytes(rawData)) return false;
-    
-    vector<uint8_t> response;
-    int bytesRead = port.readBytes(response, 6, 2); // Ждем 6 байт, 2 секунды
+    array<uint8_t, 6> response;
+    int bytesRead = transaction(ReadClosedFrame::forSlave(deviceId), response.data(), response.size(), replyTimeoutMs);
+    throwIfException(response.data(), bytesRead);
     
     if (bytesRead != 6) {
         return  false;
@@ -191,14 +238,10 @@ bool GateController::isGateClose() {
 }
 
 int GateController::getGatePosition() {
-    port.flush();
-    
-    ModbusFrame frame = { deviceId, Command::READ_INPUT_REGISTERS, 0x0000, Action::ONE_REGISTER };
-    port.sendBytes(frame.serialize());
-    
     // Ответ: ID(1) + FC(1) + BytesCount(1) + Data(2) + CRC(2) = 7 байт
-    vector<uint8_t> response;
-    int bytesRead = port.readBytes(response, 7, 1);
+    array<uint8_t, 7> response;
+    int bytesRead = transaction(ReadPositionFrame::forSlave(deviceId), response.data(), response.size(), replyTimeoutMs);
+    throwIfException(response.data(), bytesRead);
     
     if (bytesRead != 7) return -1;
     if (response[1] != 0x04) return -1;
@@ -214,3 +257,66 @@ int GateController::getGatePosition() {
     return  position;
     
 }
+
+GateState GateController::readState() {
+    GateState state = queryState();
+    stateMachine.observe(state, state.timestamp);
+    return state;
+}
+
+void GateController::setVehicleSensor(int discreteInput) {
+    if (discreteInput < 3 || discreteInput > 8) {
+        if (discreteInput != 0) cerr << "[Controller] Датчик проезда поддерживается на DI3..DI8, а не DI" << discreteInput << "\n";
+        vehicleInput = 0;
+        limitsRequest = ReadLimitsFrame::forSlave(deviceId);
+    } else {
+        // DI1..DIn в одном байте ответа - длина ответа та же, что и без датчика
+        vehicleInput = discreteInput;
+        limitsRequest = ModbusFrame::build(deviceId, Command::READ_DSSCRETE_INPUTS, 0x0001, static_cast<Action>(discreteInput));
+    }
+    stateMachine.setVehicleSensor(vehicleInput != 0);
+}
+
+GateState GateController::queryState(bool withPosition) {
+    GateState state;
+    state.timestamp = clockNow();
+    
+    // DI1 (закрыт) и DI2 (открыт) одним запросом: начиная с 0x0001, 2 входа (с датчиком проезда - до него)
+    array<uint8_t, 6> inputs;
+    int bytesRead = transaction(limitsRequest, inputs.data(), inputs.size(), replyTimeoutMs);
+    
+    if (ModbusException::isException(inputs.data(), bytesRead)) {
+        state.exceptionCode = inputs[2];
+        return state;
+    }
+    if (bytesRead != 6 || inputs[1] != 0x02) {
+        return state;
+    }
+    
+    // inputs[3] - битовая маска: бит 0 = DI1, бит 1 = DI2
+    state.isClosed = (inputs[3] & 0x01) != 0;
+    state.isOpen = (inputs[3] & 0x02) != 0;
+    if (vehicleInput != 0) {
+        state.vehiclePresent = (inputs[3] & (1 << (vehicleInput - 1))) != 0;
+    }
+    
+    if (!withPosition) {
+        state.valid = true;
+        return state;
+    }
+    
+    array<uint8_t, 7> position;
+    bytesRead = transaction(ReadPositionFrame::forSlave(deviceId), position.data(), position.size(), replyTimeoutMs);
+    
+    if (ModbusException::isException(position.data(), bytesRead)) {
+        state.exceptionCode = position[2];
+        return state;
+    }
+    if (bytesRead != 7 || position[1] != 0x04) {
+        return state;
+    }
+    
+    state.position = (position[3] << 8) | position[4];
+    state.valid = true;
+    return state;
+}
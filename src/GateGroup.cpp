@@ -0,0 +1,200 @@
+//
+//  GateGroup.cpp
+//  Parking
+//
+
+#include "GateGroup.hpp"
+#include "ModbusUtils.hpp"
+#include <iostream>
+#include <set>
+
+using namespace std;
+
+GateGroup::GateGroup(ICommunication& p, vector<GateController*> gates, vector<uint8_t> busSlaves, int turnaround)
+    : port(p), members(move(gates)), turnaroundMs(turnaround) {
+    set<uint8_t> memberIds;
+    for (auto* gate : members) {
+        memberIds.insert(gate->slaveId());
+    }
+    set<uint8_t> lineIds(busSlaves.begin(), busSlaves.end());
+    lineIds.insert(memberIds.begin(), memberIds.end());
+
+    // Broadcast задел бы slave вне группы, а slave с ID 0 ответил бы на него и сбил чужой обмен
+    broadcastable = !members.empty() && memberIds.size() == members.size() && memberIds == lineIds
+        && memberIds.count(ModbusBroadcastAddress) == 0;
+}
+
+GateGroup::~GateGroup() {
+    stop();
+}
+
+bool GateGroup::commandAll(bool open) {
+    // Таймер RFID не закроет сразу после группового открытия, ждущий /open не откроет после закрытия
+    for (auto* queue : queues) {
+        queue->supersede(open ? GateCommand::Open : GateCommand::Close);
+    }
+
+    if (broadcastable) {
+        // Coil[0] у всех slave сразу
+        ModbusCoilsFrame frame = { ModbusBroadcastAddress, 0x0000, 1, open };
+        uint8_t request[ModbusCoilsFrame::maxSize];
+        size_t length = frame.encode(request);
+
+        // Ответа на broadcast нет, шина ждет turnaround, пока slave выполняют команду
+        if (!port.broadcast(request, length, chrono::milliseconds(turnaroundMs))) {
+            cerr << "[GateGroup] Не получилось отправить групповую команду\n";
+            return false;
+        }
+        for (auto* gate : members) {
+            gate->markCommandSent(open);
+        }
+
+        cout << "[GateGroup] Групповая команда на " << (open ? "открытие" : "закрытие")
+             << " (" << members.size() << " шт., broadcast)\n";
+        return true;
+    }
+
+    // На линии есть кто-то вне группы - каждому по его адресу
+    size_t failed = 0;
+    for (auto* gate : members) {
+        try {
+            CommandDelivery delivery = gate->sendCommand(open);
+            if (delivery == CommandDelivery::NoEcho) {
+                cerr << "[GateGroup] Нет эха от slave " << static_cast<int>(gate->slaveId()) << "\n";
+                failed++;
+            } else if (delivery == CommandDelivery::NotSent) {
+                cerr << "[GateGroup] Команда slave " << static_cast<int>(gate->slaveId()) << " не ушла на линию\n";
+                failed++;
+            }
+        } catch (const ModbusException& e) {
+            cerr << "[GateGroup] Slave " << static_cast<int>(gate->slaveId()) << " отказал: " << e.what() << "\n";
+            failed++;
+        }
+    }
+
+    cout << "[GateGroup] Команда на " << (open ? "открытие" : "закрытие") << " по адресам ("
+         << members.size() - failed << " из " << members.size() << ")\n";
+    return failed == 0;
+}
+
+bool GateGroup::waitForAll(bool open, int timeoutMs) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    GatePhase target = open ? GatePhase::Open : GatePhase::Closed;
+    size_t missed = 0;
+
+    for (auto* gate : members) {
+        auto remaining = chrono::ceil<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+        if (remaining.count() < 0) remaining = chrono::milliseconds(0);
+        if (gate->waitForPhase(target, remaining) != target) missed++;
+    }
+
+    if (missed > 0) {
+        cout << "[GateGroup] Отвалились по таймауту, не дошли: " << missed << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool GateGroup::openAll(int timeoutMs) {
+    // Кому команда не ушла, тот не доедет - ждем остальных все равно, чтобы знать их фазы
+    bool sent = commandAll(true);
+    return waitForAll(true, timeoutMs) && sent;
+}
+
+bool GateGroup::closeAll(int timeoutMs) {
+    bool sent = commandAll(false);
+    return waitForAll(false, timeoutMs) && sent;
+}
+
+vector<GateState> GateGroup::states() {
+    vector<GateState> result;
+    result.reserve(members.size());
+    for (auto* gate : members) {
+        result.push_back(gate->readState());
+    }
+    return result;
+}
+
+GateGroupResult GateGroup::execute(GateCommand command, int timeoutMs) {
+    auto startedAt = chrono::steady_clock::now();
+    bool open = command == GateCommand::Open;
+
+    GateGroupResult result;
+    result.command = command;
+    result.broadcast = broadcastable;
+    result.members = members.size();
+
+    bool sent = commandAll(open);
+    waitForAll(open, timeoutMs);
+
+    GatePhase target = open ? GatePhase::Open : GatePhase::Closed;
+    for (auto* gate : members) {
+        GatePhase phase = gate->phase();
+        result.phases.push_back(phase);
+        if (phase == target) result.reached++;
+    }
+    result.ok = sent && result.reached == result.members;
+    if (!sent) result.error = "Команда ушла не всем";
+    else if (!result.ok) result.error = "Не все дошли до концевика";
+
+    result.elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startedAt);
+    return result;
+}
+
+void GateGroup::start(int timeoutMs) {
+    if (running) return;
+    commandTimeoutMs = timeoutMs;
+    running = true;
+    worker = thread([this]() { workerLoop(); });
+}
+
+void GateGroup::stop() {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+bool GateGroup::submit(GateCommand command, Completion done) {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        if (!running || pending || busy) return false;
+        pending = true;
+        nextCommand = command;
+        nextDone = move(done);
+    }
+    wake.notify_one();
+    return true;
+}
+
+void GateGroup::workerLoop() {
+    while (true) {
+        GateCommand command;
+        Completion done;
+        {
+            unique_lock<mutex> lock(jobMutex);
+            wake.wait(lock, [this]() { return !running || pending; });
+            if (!running) break;
+
+            command = nextCommand;
+            done = move(nextDone);
+            pending = false;
+            busy = true;
+        }
+
+        GateGroupResult result;
+        try {
+            result = execute(command, commandTimeoutMs);
+        } catch (const exception& e) {
+            result.command = command;
+            result.members = members.size();
+            result.error = e.what();
+        }
+        if (done) done(result);
+
+        lock_guard<mutex> lock(jobMutex);
+        busy = false;
+    }
+}
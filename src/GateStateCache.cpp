@@ -0,0 +1,124 @@
+//
+//  GateStateCache.cpp
+//  Parking
+//
+
+#include "GateStateCache.hpp"
+#include <iostream>
+
+using namespace std;
+
+GateStateCache::GateStateCache(GateController& gateController) : controller(gateController) {
+    // Команда сменила фазу - опрашиваем сразу, а не через idlePoll.
+    // Фазу, замеченную самим опросчиком, пропускаем - он и так опрашивает по новому плану
+    controller.states().addListener([this](GatePhase) {
+        if (this_thread::get_id() != poller.get_id()) requestRefresh();
+    });
+}
+
+GateStateCache::~GateStateCache() {
+    stop();
+}
+
+void GateStateCache::start() {
+    if (running) return;
+    running = true;
+    poller = thread([this]() { pollLoop(); });
+}
+
+void GateStateCache::stop() {
+    if (!running) return;
+    {
+        lock_guard<mutex> lock(signalMutex);
+        running = false;
+    }
+    pollerWake.notify_all();
+    if (poller.joinable()) {
+        poller.join();
+    }
+}
+
+void GateStateCache::requestRefresh() {
+    {
+        lock_guard<mutex> lock(signalMutex);
+        refreshRequested = true;
+    }
+    pollerWake.notify_one();
+}
+
+GatePollPlan GateStateCache::pollOnce(const GatePollPlan& plan) {
+    GateState observed = controller.poll(plan);
+    GateMotion motion = controller.states().motion();
+
+    latest.phase = motion.phase;
+    latest.speed = motion.speed;
+    latest.state.isOpen = motion.phase == GatePhase::Open;
+    latest.state.isClosed = motion.phase == GatePhase::Closed;
+    latest.state.vehiclePresent = motion.vehiclePresent;
+    latest.vehicleSensor = controller.vehicleSensor() != 0;
+    latest.state.valid = observed.valid;
+    latest.state.exceptionCode = observed.exceptionCode;
+    if (observed.valid) {
+        // Возраст снимка - от последнего ответа шлагбаума, неудачный опрос его не молодит
+        if (motion.position >= 0) latest.state.position = motion.position;
+        latest.state.timestamp = observed.timestamp;
+        latest.updatedAt = observed.timestamp;
+    }
+    latest.polls = ++polls;
+    published.store(latest);
+
+    {
+        lock_guard<mutex> lock(signalMutex);
+    }
+    snapshotReady.notify_all();
+
+    return controller.states().nextPoll(chrono::steady_clock::now());
+}
+
+GateSnapshot GateStateCache::freshSnapshot(chrono::milliseconds maxAge, chrono::milliseconds wait) {
+    GateSnapshot current = snapshot();
+    if (current.polls > 0 && current.age() <= maxAge) return current;
+
+    if (!running) {
+        // Опросчика нет - опрашиваем сами, если шина не занята ждущим команды
+        if (controller.states().beginPolling()) {
+            pollOnce({chrono::milliseconds(0), true, true});
+            controller.states().endPolling();
+        }
+        return snapshot();
+    }
+
+    uint64_t seen = current.polls;
+    requestRefresh();
+
+    unique_lock<mutex> lock(signalMutex);
+    snapshotReady.wait_for(lock, wait, [&]() { return polls > seen || !running; });
+    return snapshot();
+}
+
+void GateStateCache::pollLoop() {
+    GateStateMachine& machine = controller.states();
+
+    // Опрашиваем только мы: ждущие команд теперь ждут смены фазы, а не опрашивают сами
+    while (!machine.beginPolling()) {
+        if (!running) return;
+        machine.waitForChange(machine.motion().transitions, chrono::steady_clock::now() + chrono::milliseconds(100));
+    }
+    cout << "[GateCache] Опрос шлагбаума запущен\n";
+
+    GatePollPlan plan = {chrono::milliseconds(0), true, true};
+    while (running) {
+        plan = pollOnce(plan);
+
+        unique_lock<mutex> lock(signalMutex);
+        pollerWake.wait_for(lock, plan.delay, [this]() { return refreshRequested || !running; });
+        if (refreshRequested) {
+            // Внеочередной опрос - по плану на сейчас, без паузы
+            refreshRequested = false;
+            lock.unlock();
+            plan = machine.nextPoll(chrono::steady_clock::now());
+        }
+    }
+
+    machine.endPolling();
+}
@@ -0,0 +1,285 @@
+//
+//  GateStateMachine.cpp
+//  Parking
+//
+
+#include "GateStateMachine.hpp"
+#include "GateController.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+const char* gatePhaseName(GatePhase phase) {
+    switch (phase) {
+        case GatePhase::Unknown: return "Unknown";
+        case GatePhase::Closed: return "Closed";
+        case GatePhase::Opening: return "Opening";
+        case GatePhase::Open: return "Open";
+        case GatePhase::Closing: return "Closing";
+        case GatePhase::Fault: return "Fault";
+    }
+    return "Unknown";
+}
+
+void GateStateMachine::setTiming(const Timing& pollTiming) {
+    lock_guard<mutex> lock(stateMutex);
+    schedule = pollTiming;
+}
+
+void GateStateMachine::setVehicleSensor(bool enabled) {
+    lock_guard<mutex> lock(stateMutex);
+    vehicleSensor = enabled;
+    vehiclePresent = false;
+}
+
+GateStateMachine::Timing GateStateMachine::timing() const {
+    lock_guard<mutex> lock(stateMutex);
+    return schedule;
+}
+
+bool GateStateMachine::moveTo(GatePhase next, Clock::time_point now) {
+    if (next == current) return false;
+
+    current = next;
+    phaseSince = now;
+    transitions++;
+    changed.notify_all();
+    return true;
+}
+
+bool GateStateMachine::checkTravelTimeout(Clock::time_point now) {
+    bool moving = current == GatePhase::Opening || current == GatePhase::Closing;
+    if (moving && now - commandAt > schedule.travelTimeout) {
+        return moveTo(GatePhase::Fault, now);
+    }
+    return false;
+}
+
+void GateStateMachine::trackPosition(int value, Clock::time_point now) {
+    position = value;
+    if (current != GatePhase::Opening && current != GatePhase::Closing) return;
+
+    // Скорость от первой точки хода, а не между соседними опросами:
+    // положение целое в %, и на коротком интервале шаг квантования больше самого движения
+    if (startPosition < 0) {
+        startPosition = value;
+        startAt = now;
+        return;
+    }
+    double elapsedMs = chrono::duration<double, milli>(now - startAt).count();
+    if (elapsedMs > 0 && value != startPosition) {
+        speedPerMs = (value - startPosition) / elapsedMs;
+    }
+}
+
+void GateStateMachine::commandSent(bool open, Clock::time_point now) {
+    unique_lock<mutex> lock(stateMutex);
+    bool moved = applyCommand(open, now);
+    GatePhase phase = current;
+    lock.unlock();
+
+    if (moved) {
+        for (auto& listener : listeners) listener(phase);
+    }
+}
+
+bool GateStateMachine::observe(const GateState& state, Clock::time_point now) {
+    unique_lock<mutex> lock(stateMutex);
+    bool moved = applyObservation(state, now);
+    bool vehicleChanged = applyVehicle(state);
+    GatePhase phase = current;
+    bool present = vehiclePresent;
+    lock.unlock();
+
+    if (moved) {
+        for (auto& listener : listeners) listener(phase);
+    }
+    if (vehicleChanged) {
+        for (auto& listener : vehicleListeners) listener(present);
+    }
+    return moved;
+}
+
+bool GateStateMachine::applyVehicle(const GateState& state) {
+    if (!vehicleSensor || !state.valid || state.vehiclePresent == vehiclePresent) return false;
+    vehiclePresent = state.vehiclePresent;
+    return true;
+}
+
+bool GateStateMachine::observePosition(int value, Clock::time_point now) {
+    unique_lock<mutex> lock(stateMutex);
+    bool moved = applyPosition(value, now);
+    GatePhase phase = current;
+    lock.unlock();
+
+    if (moved) {
+        for (auto& listener : listeners) listener(phase);
+    }
+    return moved;
+}
+
+bool GateStateMachine::applyCommand(bool open, Clock::time_point now) {
+    // Ход считаем от команды и последнего известного положения
+    commandAt = now;
+    startPosition = position;
+    startAt = now;
+    speedPerMs = 0;
+    failedPolls = 0;
+
+    // Уже стоит где надо - ехать некуда, следующий опрос это подтвердит
+    if ((open && current == GatePhase::Open) || (!open && current == GatePhase::Closed)) return false;
+    return moveTo(open ? GatePhase::Opening : GatePhase::Closing, now);
+}
+
+bool GateStateMachine::applyObservation(const GateState& state, Clock::time_point now) {
+    if (!state.valid) {
+        // Отказ slave - сразу, молчание - после нескольких опросов подряд
+        if (state.exceptionCode != 0 || ++failedPolls >= schedule.maxFailedPolls) {
+            return moveTo(GatePhase::Fault, now);
+        }
+        return checkTravelTimeout(now);
+    }
+    failedPolls = 0;
+
+    int previous = position;
+    bool moved = false;
+    bool withinTravel = now - commandAt <= schedule.travelTimeout;
+
+    if (state.isOpen && state.isClosed) {
+        moved = moveTo(GatePhase::Fault, now);
+    } else if (state.isOpen) {
+        // Сразу после команды на закрытие стрела еще на концевике открытия - это не конец хода
+        if (!(current == GatePhase::Closing && withinTravel)) moved = moveTo(GatePhase::Open, now);
+    } else if (state.isClosed) {
+        if (!(current == GatePhase::Opening && withinTravel)) moved = moveTo(GatePhase::Closed, now);
+    } else {
+        // Между концевиками
+        switch (current) {
+            case GatePhase::Opening:
+            case GatePhase::Closing:
+                moved = checkTravelTimeout(now);
+                break;
+            case GatePhase::Open:
+            case GatePhase::Closed:
+                // Поехал без нашей команды (пульт, другой контроллер)
+                commandAt = now;
+                startPosition = -1;
+                speedPerMs = 0;
+                moved = moveTo(current == GatePhase::Open ? GatePhase::Closing : GatePhase::Opening, now);
+                break;
+            case GatePhase::Unknown:
+            case GatePhase::Fault:
+                // Направление видно только по изменению положения
+                if (previous >= 0 && state.position >= 0 && state.position != previous) {
+                    commandAt = now;
+                    startPosition = -1;
+                    speedPerMs = 0;
+                    moved = moveTo(state.position > previous ? GatePhase::Opening : GatePhase::Closing, now);
+                }
+                break;
+        }
+    }
+
+    if (state.position >= 0) trackPosition(state.position, now);
+    return moved;
+}
+
+bool GateStateMachine::applyPosition(int value, Clock::time_point now) {
+    if (value < 0) {
+        if (++failedPolls >= schedule.maxFailedPolls) return moveTo(GatePhase::Fault, now);
+    } else {
+        failedPolls = 0;
+        trackPosition(value, now);
+    }
+    return checkTravelTimeout(now);
+}
+
+GatePollPlan GateStateMachine::nextPoll(Clock::time_point now) const {
+    lock_guard<mutex> lock(stateMutex);
+
+    switch (current) {
+        case GatePhase::Opening:
+        case GatePhase::Closing: {
+            bool opening = current == GatePhase::Opening;
+            double towardsTarget = opening ? speedPerMs : -speedPerMs;
+
+            // Положение не читается или еще неизвестно - полным опросом
+            if (failedPolls > 0 || position < 0) return {schedule.fastPoll, true, true};
+
+            int distance = opening ? 100 - position : position;
+            if (distance <= 0) return {schedule.fastPoll, true, false};
+
+            // Еще не тронулись: сразу после команды часто, дальше реже - мотор может стартовать с задержкой
+            if (towardsTarget <= 0) {
+                auto waiting = chrono::duration_cast<chrono::milliseconds>(now - commandAt);
+                return {clamp(waiting / 2, schedule.fastPoll, schedule.slowPoll), false, true};
+            }
+
+            // Положение округлено вниз до процента - в среднем стрела на полпроцента дальше.
+            // До расчетного прихода на концевик - половина оставшегося, но не реже slowPoll.
+            // Когда осталось меньше двух быстрых опросов - только концевики к расчетному моменту
+            auto remaining = chrono::milliseconds(static_cast<int64_t>(ceil((distance - 0.5) / towardsTarget)));
+            if (remaining <= schedule.fastPoll * 2) return {remaining, true, false};
+            return {clamp(remaining / 2, schedule.fastPoll, schedule.slowPoll), false, true};
+        }
+        case GatePhase::Unknown:
+            return {schedule.fastPoll, true, true};
+        case GatePhase::Open:
+            // Ждем проезда: только входы, положение на концевике и так известно
+            if (vehicleSensor) return {schedule.vehiclePoll, true, false};
+            return {schedule.idlePoll, true, true};
+        case GatePhase::Closed:
+        case GatePhase::Fault:
+            return {schedule.idlePoll, true, true};
+    }
+    return {schedule.idlePoll, true, true};
+}
+
+GatePhase GateStateMachine::phase() const {
+    lock_guard<mutex> lock(stateMutex);
+    return current;
+}
+
+GateMotion GateStateMachine::motion() const {
+    lock_guard<mutex> lock(stateMutex);
+
+    GateMotion snapshot;
+    snapshot.phase = current;
+    snapshot.position = position;
+    snapshot.speed = speedPerMs * 1000.0;
+    snapshot.phaseSince = phaseSince;
+    snapshot.transitions = transitions;
+    snapshot.vehiclePresent = vehiclePresent;
+    return snapshot;
+}
+
+bool GateStateMachine::isMoving() const {
+    lock_guard<mutex> lock(stateMutex);
+    return current == GatePhase::Opening || current == GatePhase::Closing;
+}
+
+bool GateStateMachine::beginPolling() {
+    lock_guard<mutex> lock(stateMutex);
+    if (polling) return false;
+    polling = true;
+    return true;
+}
+
+void GateStateMachine::endPolling() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        polling = false;
+    }
+    changed.notify_all();
+}
+
+bool GateStateMachine::isPolling() const {
+    lock_guard<mutex> lock(stateMutex);
+    return polling;
+}
+
+void GateStateMachine::waitForChange(uint64_t seenTransitions, Clock::time_point deadline) {
+    unique_lock<mutex> lock(stateMutex);
+    changed.wait_until(lock, deadline, [&]() { return transitions != seenTransitions || !polling; });
+}
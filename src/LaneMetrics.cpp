@@ -0,0 +1,70 @@
+//
+//  LaneMetrics.cpp
+//  Parking
+//
+
+#include "LaneMetrics.hpp"
+
+using namespace std;
+
+void LaneMetrics::touch(Clock::time_point now) {
+    if (!started) {
+        firstEvent = now;
+        started = true;
+    }
+}
+
+void LaneMetrics::vehiclePassed(Clock::time_point now) {
+    lock_guard<mutex> lock(metricsMutex);
+    touch(now);
+    passages.push_back(now);
+    vehicles++;
+    if (open) cycleVehicles++;
+}
+
+void LaneMetrics::gateOpened(Clock::time_point now) {
+    lock_guard<mutex> lock(metricsMutex);
+    touch(now);
+    openedAt = now;
+    open = true;
+}
+
+void LaneMetrics::gateClosed(Clock::time_point now) {
+    lock_guard<mutex> lock(metricsMutex);
+    // Закрытие без открытия (старт программы, пульт) - не цикл
+    if (!open) return;
+    open = false;
+    cycles++;
+    cyclesTotal += chrono::duration_cast<chrono::milliseconds>(now - openedAt);
+}
+
+LaneStats LaneMetrics::stats(Clock::time_point now) const {
+    lock_guard<mutex> lock(metricsMutex);
+
+    while (!passages.empty() && now - passages.front() > window) {
+        passages.pop_front();
+    }
+
+    LaneStats result;
+    result.vehicles = vehicles;
+    result.cycles = cycles;
+    if (cycles > 0) {
+        result.averageCycle = cyclesTotal / cycles;
+        result.vehiclesPerCycle = static_cast<double>(cycleVehicles) / cycles;
+    }
+
+    // Пока не набралось окна - делим на то, что прошло с первого события
+    if (started) {
+        auto span = min<Clock::duration>(window, now - firstEvent);
+        double minutes = chrono::duration<double, ratio<60>>(span).count();
+        if (minutes > 0) result.vehiclesPerMinute = passages.size() / minutes;
+    }
+    return result;
+}
+
+void LaneMetrics::print(ostream& out, Clock::time_point now) const {
+    LaneStats current = stats(now);
+    out << "машин/мин " << current.vehiclesPerMinute << ", проездов " << current.vehicles
+        << ", циклов " << current.cycles << ", цикл в среднем " << current.averageCycle.count() << " мс"
+        << ", машин на цикл " << current.vehiclesPerCycle;
+}
@@ -0,0 +1,357 @@
+//
+//  ModbusBusMaster.cpp
+//  Parking
+//
+
+#include "ModbusBusMaster.hpp"
+#include "ModbusUtils.hpp"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+// MARK: Канал одного slave
+
+class ModbusBusMaster::BusChannel: public ICommunication {
+private:
+    ModbusBusMaster& master;
+    uint8_t slaveId;
+    
+    // Ответы, которые master получил для этого slave
+    mutex inboxMutex;
+    condition_variable inboxCondition;
+    deque<uint8_t> inbox;
+public:
+    BusChannel(ModbusBusMaster& m, uint8_t id) : master(m), slaveId(id) {}
+    
+    bool connect(const string&) override { return true; }
+    void disconnect() override {}
+    
+    bool sendBytes(const uint8_t* data, size_t length) override {
+        if (length < 2 || length > ModbusRtuFramer::maxFrameSize) return false;
+        master.enqueue(slaveId, data, length);
+        return true;
+    }
+    
+    // Очередь шины - у master, своя BusTurn не нужна
+    TransactResult transact(const uint8_t* request, size_t length, ReplySpec reply, chrono::steady_clock::time_point deadline) override {
+        if (length < 2 || length > ModbusRtuFramer::maxFrameSize) return TransactResult::NotSent;
+        return master.exchange(slaveId, request, length, reply, deadline);
+    }
+    
+    bool broadcast(const uint8_t* request, size_t length, chrono::milliseconds turnaround) override {
+        if (length < 2 || length > ModbusRtuFramer::maxFrameSize) return false;
+        return master.broadcast(request, length, turnaround);
+    }
+    
+    int readAvailable(uint8_t* buffer, int capacity, int timeoutMs) override {
+        unique_lock<mutex> lock(inboxMutex);
+        inboxCondition.wait_for(lock, chrono::milliseconds(timeoutMs), [this]() { return !inbox.empty(); });
+        
+        int n = min<int>(capacity, static_cast<int>(inbox.size()));
+        copy(inbox.begin(), inbox.begin() + n, buffer);
+        inbox.erase(inbox.begin(), inbox.begin() + n);
+        return n;
+    }
+    
+    void flush() override {
+        lock_guard<mutex> lock(inboxMutex);
+        inbox.clear();
+    }
+    
+    bool hasLineTiming() const override { return master.port.hasLineTiming(); }
+    
+    void deliver(const uint8_t* data, size_t length) {
+        {
+            lock_guard<mutex> lock(inboxMutex);
+            inbox.insert(inbox.end(), data, data + length);
+        }
+        inboxCondition.notify_all();
+    }
+};
+
+// MARK: Master
+
+ModbusBusMaster::ModbusBusMaster(ICommunication& p, int baudRate, int timeoutMs, int turnaround)
+    : port(p), framer(baudRate), replyTimeoutMs(timeoutMs), turnaroundMs(turnaround), running(false) {
+    framer.setGapDetection(port.hasLineTiming());
+}
+
+ModbusBusMaster::~ModbusBusMaster() {
+    stop();
+}
+
+ICommunication& ModbusBusMaster::channel(uint8_t slaveId) {
+    lock_guard<mutex> lock(queueMutex);
+    
+    auto& ch = channels[slaveId];
+    if (!ch) {
+        ch = make_unique<BusChannel>(*this, slaveId);
+        slaveStats[slaveId];
+    }
+    return *ch;
+}
+
+void ModbusBusMaster::start() {
+    if (running) return;
+    // Порт под оберткой могли выбрать уже после конструктора
+    framer.setGapDetection(port.hasLineTiming());
+    running = true;
+    worker = thread(&ModbusBusMaster::workerLoop, this);
+}
+
+void ModbusBusMaster::stop() {
+    {
+        // Под мьютексом: иначе worker может проверить running и уснуть уже после notify
+        lock_guard<mutex> lock(queueMutex);
+        running = false;
+    }
+    queueCondition.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+SlaveStats ModbusBusMaster::stats(uint8_t slaveId) {
+    lock_guard<mutex> lock(queueMutex);
+    return slaveStats[slaveId];
+}
+
+map<uint8_t, SlaveStats> ModbusBusMaster::allStats() {
+    lock_guard<mutex> lock(queueMutex);
+    return slaveStats;
+}
+
+ModbusBusMaster::Lane ModbusBusMaster::laneFor(const uint8_t* request) {
+    // Запись (coil/register) - это команда шлагбауму, чтение - опрос
+    switch (request[1]) {
+        case 0x05:
+        case 0x06:
+        case 0x0F:
+        case 0x10:
+            return Lane::Command;
+        default:
+            return Lane::Poll;
+    }
+}
+
+void ModbusBusMaster::enqueue(uint8_t slaveId, const uint8_t* data, size_t length) {
+    Job job;
+    job.slaveId = slaveId;
+    job.lane = laneFor(data);
+    job.length = length;
+    job.enqueuedAt = chrono::steady_clock::now();
+    job.startBy = job.enqueuedAt + chrono::milliseconds(queueTimeoutMs);
+    job.replyWindow = chrono::milliseconds(replyTimeoutMs);
+    job.broadcast = data[0] == ModbusBroadcastAddress;
+    job.turnaround = chrono::milliseconds(turnaroundMs);
+    memcpy(job.request, data, length);
+    
+    {
+        lock_guard<mutex> lock(queueMutex);
+        auto& queues = job.lane == Lane::Command ? commandQueues : pollQueues;
+        queues[slaveId].push_back(job);
+    }
+    queueCondition.notify_one();
+}
+
+TransactResult ModbusBusMaster::exchange(uint8_t slaveId, const uint8_t* request, size_t length, ReplySpec reply, chrono::steady_clock::time_point deadline) {
+    Exchange exchange;
+    exchange.reply = reply;
+    
+    Job job;
+    job.slaveId = slaveId;
+    job.lane = laneFor(request);
+    job.length = length;
+    job.enqueuedAt = chrono::steady_clock::now();
+    // Дедлайн вызывающего - это его окно на ответ, отсчитываем его от выхода на линию.
+    // Очередь ждет по своему бюджету
+    job.replyWindow = deadline - job.enqueuedAt;
+    if (job.replyWindow <= chrono::steady_clock::duration::zero()) return TransactResult::NotSent;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        job.startBy = job.enqueuedAt + chrono::milliseconds(queueTimeoutMs);
+    }
+    job.exchange = &exchange;
+    memcpy(job.request, request, length);
+    return await(job, exchange);
+}
+
+bool ModbusBusMaster::broadcast(const uint8_t* request, size_t length, chrono::milliseconds turnaround) {
+    Exchange exchange;
+    
+    Job job;
+    job.slaveId = ModbusBroadcastAddress;
+    job.lane = Lane::Command;
+    job.length = length;
+    job.enqueuedAt = chrono::steady_clock::now();
+    {
+        lock_guard<mutex> lock(queueMutex);
+        job.startBy = job.enqueuedAt + chrono::milliseconds(queueTimeoutMs);
+    }
+    job.exchange = &exchange;
+    job.broadcast = true;
+    job.turnaround = turnaround;
+    memcpy(job.request, request, length);
+    // Ответа нет: Replied здесь значит ушел на линию и turnaround выдержан
+    return await(job, exchange) == TransactResult::Replied;
+}
+
+TransactResult ModbusBusMaster::await(Job& job, Exchange& exchange) {
+    unique_lock<mutex> lock(queueMutex);
+    auto& queues = job.lane == Lane::Command ? commandQueues : pollQueues;
+    queues[job.slaveId].push_back(job);
+    queueCondition.notify_one();
+    
+    if (!exchangeDone.wait_until(lock, job.startBy, [&exchange]() { return exchange.started || exchange.finished; })) {
+        if (cancel(job.slaveId, job.lane, &exchange)) {
+            slaveStats[job.slaveId].cancelled++;
+            return TransactResult::NotSent;
+        }
+    }
+    // Уже на линии: worker ждет ответ не дольше окна от отправки
+    exchangeDone.wait(lock, [&exchange]() { return exchange.finished; });
+    return exchange.result;
+}
+
+bool ModbusBusMaster::cancel(uint8_t slaveId, Lane lane, Exchange* exchange) {
+    auto& queue = (lane == Lane::Command ? commandQueues : pollQueues)[slaveId];
+    auto it = find_if(queue.begin(), queue.end(), [exchange](const Job& job) { return job.exchange == exchange; });
+    if (it == queue.end()) return false;
+    queue.erase(it);
+    return true;
+}
+
+bool ModbusBusMaster::popRoundRobin(map<uint8_t, deque<Job>>& queues, uint8_t& lastSlave, Job& job) {
+    if (queues.empty()) return false;
+    
+    // Следующий slave после того, кого обслужили последним
+    auto it = queues.upper_bound(lastSlave);
+    for (size_t i = 0; i < queues.size(); i++) {
+        if (it == queues.end()) it = queues.begin();
+        
+        if (!it->second.empty()) {
+            job = it->second.front();
+            it->second.pop_front();
+            lastSlave = it->first;
+            return true;
+        }
+        ++it;
+    }
+    return false;
+}
+
+bool ModbusBusMaster::popNext(Job& job) {
+    return popRoundRobin(commandQueues, lastCommandSlave, job)
+        || popRoundRobin(pollQueues, lastPollSlave, job);
+}
+
+void ModbusBusMaster::workerLoop() {
+    if (realtime.enabled()) {
+        Realtime::applyToCurrentThread(realtime, "bus master");
+    }
+    
+    while (running) {
+        Job job;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this, &job]() { return !running || popNext(job); });
+            if (!running) {
+                // Вынули, но не выполним - вызывающий не должен ждать до дедлайна
+                if (job.exchange) job.exchange->finished = true;
+                exchangeDone.notify_all();
+                break;
+            }
+            
+            if (chrono::steady_clock::now() >= job.startBy) {
+                // Бюджет очереди вышел - вызывающий его уже не ждет
+                slaveStats[job.slaveId].cancelled++;
+                if (job.exchange) job.exchange->finished = true;
+                exchangeDone.notify_all();
+                continue;
+            }
+            if (job.exchange) job.exchange->started = true;
+        }
+        
+        execute(job);
+        
+        // Пауза t3.5 перед следующим запросом, чтобы slave увидели границу кадра
+        this_thread::sleep_for(framer.silenceInterval());
+    }
+}
+
+void ModbusBusMaster::execute(const Job& job) {
+    auto startedAt = chrono::steady_clock::now();
+    uint64_t queueWaitUs = chrono::duration_cast<chrono::microseconds>(startedAt - job.enqueuedAt).count();
+    {
+        lock_guard<mutex> lock(queueMutex);
+        SlaveStats& s = slaveStats[job.slaveId];
+        s.maxQueueWaitUs = max(s.maxQueueWaitUs, queueWaitUs);
+    }
+    
+    // На broadcast никто не отвечает, шина ждет пока slave его выполнят
+    if (job.broadcast) {
+        bool sent = port.broadcast(job.request, job.length, job.turnaround);
+        finish(job, sent ? TransactResult::Replied : TransactResult::NotSent);
+        return;
+    }
+    
+    // Окно на ответ - с выхода на линию, а не с постановки в очередь
+    auto deadline = startedAt + min<chrono::steady_clock::duration>(job.replyWindow, chrono::milliseconds(replyTimeoutMs));
+    TransactResult result;
+    
+    if (job.exchange) {
+        // Ответ разбирает вызывающий (его ReplySpec), он ждет на exchangeDone
+        result = port.transact(job.request, job.length, job.exchange->reply, deadline);
+    } else {
+        BusChannel* target = nullptr;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            target = channels[job.slaveId].get();
+        }
+        
+        framer.reset();
+        uint8_t function = job.request[1];
+        auto collect = [&](const uint8_t* data, size_t length, chrono::steady_clock::time_point arrivedAt) {
+            framer.feed(data, length, arrivedAt);
+            ModbusRtuFrame frame;
+            while (framer.nextFrame(frame)) {
+                if (frame.address() != job.slaveId || (frame.function() & 0x7F) != function) continue;
+                if (target) target->deliver(frame.data, frame.length);
+                return true;
+            }
+            return false;
+        };
+        result = port.transact(job.request, job.length, ReplySpec::from(collect), deadline);
+    }
+    
+    if (result == TransactResult::Replied) {
+        uint64_t latencyUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startedAt).count();
+        lock_guard<mutex> lock(queueMutex);
+        SlaveStats& s = slaveStats[job.slaveId];
+        s.totalLatencyUs += latencyUs;
+        s.maxLatencyUs = max(s.maxLatencyUs, latencyUs);
+    } else if (result == TransactResult::NoReply) {
+        cerr << "[Bus] Нет ответа от slave " << static_cast<int>(job.slaveId) << "\n";
+    } else {
+        cerr << "[Bus] Запрос к slave " << static_cast<int>(job.slaveId) << " не ушел на линию\n";
+    }
+    finish(job, result);
+}
+
+void ModbusBusMaster::finish(const Job& job, TransactResult result) {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        SlaveStats& s = slaveStats[job.slaveId];
+        if (result == TransactResult::Replied) s.transactions++;
+        else if (result == TransactResult::NoReply) s.timeouts++;
+        else s.sendErrors++;
+        
+        if (job.exchange) {
+            job.exchange->result = result;
+            job.exchange->finished = true;
+        }
+    }
+    if (job.exchange) exchangeDone.notify_all();
+}
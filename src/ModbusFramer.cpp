@@ -0,0 +1,161 @@
+//
+//  ModbusFramer.cpp
+//  Parking
+//
+
+#include "ModbusFramer.hpp"
+#include "ModbusUtils.hpp"
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+ModbusRtuFramer::ModbusRtuFramer(int baudRate, Direction dir) : direction(dir) {
+    setBaudRate(baudRate);
+}
+
+void ModbusRtuFramer::setBaudRate(int baudRate) {
+    // По стандарту символ = 11 бит, пауза 3.5 символа.
+    // Выше 19200 бод стандарт фиксирует паузу 1750 мкс.
+    if (baudRate <= 0 || baudRate > 19200) {
+        silence = chrono::microseconds(1750);
+    } else {
+        silence = chrono::microseconds(3500000LL * 11 / baudRate);
+    }
+}
+
+void ModbusRtuFramer::reset() {
+    head = 0;
+    tail = 0;
+}
+
+void ModbusRtuFramer::feed(const uint8_t* data, size_t length, Clock::time_point now) {
+    // Линия молчала дольше t3.5 - недособранный кадр уже не продолжится
+    if (gapDetection && pending() > 0 && now - lastByteTime > silence) {
+        garbageBytes += pending();
+        reset();
+    }
+    lastByteTime = now;
+    
+    // Сдвигаем остаток в начало буфера
+    if (head > 0) {
+        memmove(buffer, buffer + head, pending());
+        tail -= head;
+        head = 0;
+    }
+    
+    // В буфер не влезает - старые байты точно не кадр
+    if (length > sizeof(buffer)) {
+        garbageBytes += tail + (length - sizeof(buffer));
+        data += length - sizeof(buffer);
+        length = sizeof(buffer);
+        tail = 0;
+    }
+    if (tail + length > sizeof(buffer)) {
+        size_t overflow = tail + length - sizeof(buffer);
+        garbageBytes += overflow;
+        memmove(buffer, buffer + overflow, tail - overflow);
+        tail -= overflow;
+    }
+    
+    memcpy(buffer + tail, data, length);
+    tail += length;
+}
+
+bool ModbusRtuFramer::nextFrame(ModbusRtuFrame& frame) {
+    while (pending() > 0) {
+        int expected = predictLength();
+        
+        if (expected < 0) {
+            // Неизвестный код функции, сдвигаемся на байт и ищем начало кадра дальше
+            drop(1);
+            garbageBytes++;
+            continue;
+        }
+        
+        if (expected == 0 || pending() < (size_t)expected) {
+            // Начало могло оказаться мусором, похожим на заголовок.
+            // Если дальше в буфере уже лежит целый кадр с верным CRC - перескакиваем к нему.
+            size_t offset = findCompleteFrame();
+            if (offset == 0) return false;
+            drop(offset);
+            garbageBytes += offset;
+            continue;
+        }
+        
+        const uint8_t* start = buffer + head;
+        uint16_t receivedCRC = start[expected - 2] | (start[expected - 1] << 8);
+        
+        if (ModbusUtils::calculateCRC(start, expected - 2) == receivedCRC) {
+            frame.data = start;
+            frame.length = expected;
+            drop(expected);
+            frames++;
+            return true;
+        }
+        
+        // CRC не сошелся, считаем первый байт мусором и пробуем дальше
+        crcErrors++;
+        drop(1);
+        garbageBytes++;
+    }
+    
+    return false;
+}
+
+size_t ModbusRtuFramer::findCompleteFrame() const {
+    for (size_t offset = 1; offset + 4 <= pending(); offset++) {
+        int expected = predictLength(offset);
+        if (expected <= 0 || offset + expected > pending()) continue;
+        
+        const uint8_t* start = buffer + head + offset;
+        uint16_t receivedCRC = start[expected - 2] | (start[expected - 1] << 8);
+        if (ModbusUtils::calculateCRC(start, expected - 2) == receivedCRC) {
+            return offset;
+        }
+    }
+    return 0;
+}
+
+int ModbusRtuFramer::predictLength(size_t offset) const {
+    size_t available = pending() - offset;
+    if (available < 2) return 0;
+    
+    const uint8_t* start = buffer + head + offset;
+    uint8_t function = start[1];
+    
+    // Исключение: ID + FC|0x80 + Код ошибки + CRC
+    if (function & 0x80) {
+        return direction == Direction::Response ? 5 : -1;
+    }
+    
+    switch (function) {
+        case 0x01:
+        case 0x02:
+        case 0x03:
+        case 0x04:
+            if (direction == Direction::Request) return 8;
+            // Ответ: ID + FC + Кол-во байт + Данные + CRC
+            if (available < 3) return 0;
+            return 3 + start[2] + 2;
+        case 0x05:
+        case 0x06:
+            return 8;
+        case 0x0F:
+        case 0x10:
+            if (direction == Direction::Response) return 8;
+            // Запрос: ID + FC + Адрес(2) + Кол-во(2) + Кол-во байт + Данные + CRC
+            if (available < 7) return 0;
+            return 7 + start[6] + 2;
+        default:
+            return -1;
+    }
+}
+
+void ModbusRtuFramer::drop(size_t count) {
+    head += min(count, pending());
+    if (head == tail) {
+        head = 0;
+        tail = 0;
+    }
+}
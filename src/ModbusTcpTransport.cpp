@@ -0,0 +1,235 @@
+//
+//  ModbusTcpTransport.cpp
+//  Parking
+//
+
+#include "ModbusTcpTransport.hpp"
+#include "ModbusUtils.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+ModbusTcpTransport::ModbusTcpTransport(int timeoutMs) : TcpTransport(timeoutMs) {}
+
+int ModbusTcpTransport::sendFrame(const uint8_t* rtuFrame, size_t length, bool pipeline) {
+    // Адрес + FC + CRC минимум
+    if (length < 4 || length > 256) return -1;
+    
+    // Без адреса и CRC
+    size_t pduLength = length - 3;
+    uint8_t header[mbapHeaderSize];
+    
+    uint16_t transactionId;
+    {
+        lock_guard<mutex> lock(stateMutex);
+        transactionId = nextTransactionId++;
+        if (nextTransactionId == 0) nextTransactionId = 1;
+        (pipeline ? pipelined : streamed).insert(transactionId);
+    }
+    
+    // MBAP, все поля Big-Endian
+    header[0] = (transactionId >> 8) & 0xFF;
+    header[1] = transactionId & 0xFF;
+    header[2] = 0; // Protocol ID
+    header[3] = 0;
+    header[4] = ((pduLength + 1) >> 8) & 0xFF; // Unit ID + PDU
+    header[5] = (pduLength + 1) & 0xFF;
+    header[6] = rtuFrame[0]; // Unit ID = адрес slave
+    
+    // PDU уходит прямо из RTU кадра, без копии в ADU
+    ByteSpan parts[] = {
+        {header, mbapHeaderSize},
+        {rtuFrame + 1, pduLength}
+    };
+    
+    bool ok;
+    {
+        lock_guard<mutex> lock(sendMutex);
+        ok = writeParts(parts, 2, chrono::steady_clock::now() + chrono::milliseconds(connectTimeoutMs));
+    }
+    
+    if (!ok) {
+        lock_guard<mutex> lock(stateMutex);
+        pipelined.erase(transactionId);
+        streamed.erase(transactionId);
+        return -1;
+    }
+    return transactionId;
+}
+
+bool ModbusTcpTransport::sendBytes(const uint8_t* data, size_t length) {
+    return sendFrame(data, length, false) >= 0;
+}
+
+int ModbusTcpTransport::submit(const uint8_t* rtuFrame, size_t length) {
+    return sendFrame(rtuFrame, length, true);
+}
+
+void ModbusTcpTransport::dispatch(const uint8_t* adu, size_t length) {
+    uint16_t transactionId = (adu[0] << 8) | adu[1];
+    size_t pduLength = length - mbapHeaderSize;
+    
+    // Обратно в RTU вид: Unit ID + PDU + CRC
+    uint8_t rtu[256];
+    rtu[0] = adu[6];
+    memcpy(rtu + 1, adu + mbapHeaderSize, pduLength);
+    uint16_t crc = ModbusUtils::calculateCRC(rtu, pduLength + 1);
+    rtu[pduLength + 1] = crc & 0xFF;
+    rtu[pduLength + 2] = (crc >> 8) & 0xFF;
+    size_t rtuLength = pduLength + 3;
+    
+    lock_guard<mutex> lock(stateMutex);
+    if (pipelined.erase(transactionId)) {
+        completed[transactionId].assign(rtu, rtu + rtuLength);
+    } else if (streamed.erase(transactionId)) {
+        streamReplies.insert(streamReplies.end(), rtu, rtu + rtuLength);
+    } else {
+        unmatched++;
+        cerr << "[ModbusTCP] Ответ на неизвестную транзакцию " << transactionId << "\n";
+    }
+}
+
+bool ModbusTcpTransport::receive(int timeoutMs) {
+    int n = readSome(rxBuffer + rxLength, sizeof(rxBuffer) - rxLength, timeoutMs);
+    if (n < 0) return false;
+    rxLength += n;
+    
+    size_t offset = 0;
+    while (rxLength - offset >= mbapHeaderSize) {
+        const uint8_t* adu = rxBuffer + offset;
+        uint16_t protocolId = (adu[2] << 8) | adu[3];
+        size_t length = (adu[4] << 8) | adu[5];
+        
+        // Мусор в потоке TCP - синхронизацию уже не восстановить
+        if (protocolId != 0 || length < 2 || length > 254) {
+            cerr << "[ModbusTCP] Неверный MBAP заголовок, сбрасываем буфер\n";
+            rxLength = 0;
+            return true;
+        }
+        
+        size_t aduLength = mbapHeaderSize - 1 + length;
+        if (rxLength - offset < aduLength) break;
+        
+        dispatch(adu, aduLength);
+        offset += aduLength;
+    }
+    
+    memmove(rxBuffer, rxBuffer + offset, rxLength - offset);
+    rxLength -= offset;
+    return true;
+}
+
+bool ModbusTcpTransport::pump(int timeoutMs) {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        reading = true;
+    }
+    bool ok = receive(timeoutMs);
+    {
+        lock_guard<mutex> lock(stateMutex);
+        reading = false;
+    }
+    replyCondition.notify_all();
+    return ok;
+}
+
+int ModbusTcpTransport::awaitReply(uint16_t transactionId, uint8_t* reply, size_t capacity, int timeoutMs) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    
+    while (true) {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            auto it = completed.find(transactionId);
+            if (it != completed.end()) {
+                vector<uint8_t> frame = move(it->second);
+                completed.erase(it);
+                if (frame.size() > capacity) return -1;
+                memcpy(reply, frame.data(), frame.size());
+                return static_cast<int>(frame.size());
+            }
+        }
+        
+        auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        if (remaining <= 0) break;
+        
+        // Сокет читает кто-то один, остальные ждут, пока он разложит ответы.
+        // Читающий дождался своего и ушел - следующий ждущий становится читающим
+        unique_lock<mutex> reader(recvMutex, try_to_lock);
+        if (reader.owns_lock()) {
+            if (!pump(static_cast<int>(remaining))) break;
+        } else {
+            unique_lock<mutex> lock(stateMutex);
+            replyCondition.wait_for(lock, chrono::milliseconds(remaining), [this, transactionId]() {
+                return completed.count(transactionId) > 0 || !reading;
+            });
+        }
+    }
+    
+    lock_guard<mutex> lock(stateMutex);
+    pipelined.erase(transactionId);
+    return -1;
+}
+
+int ModbusTcpTransport::readAvailable(uint8_t* buffer, int capacity, int timeoutMs) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    
+    while (true) {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            if (!streamReplies.empty()) {
+                int n = min<int>(capacity, static_cast<int>(streamReplies.size()));
+                copy(streamReplies.begin(), streamReplies.begin() + n, buffer);
+                streamReplies.erase(streamReplies.begin(), streamReplies.begin() + n);
+                return n;
+            }
+        }
+        
+        auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        
+        lock_guard<mutex> reader(recvMutex);
+        if (!pump(max<int>(0, static_cast<int>(remaining)))) return -1;
+        
+        lock_guard<mutex> lock(stateMutex);
+        if (streamReplies.empty() && remaining <= 0) return 0;
+    }
+}
+
+void ModbusTcpTransport::flush() {
+    lock_guard<mutex> reader(recvMutex);
+    uint8_t buffer[1024];
+    while (readSome(buffer, sizeof(buffer), 0) > 0) {}
+    
+    lock_guard<mutex> lock(stateMutex);
+    rxLength = 0;
+    streamReplies.clear();
+    streamed.clear();
+}
+
+size_t ModbusTcpTransport::inFlight() {
+    lock_guard<mutex> lock(stateMutex);
+    return pipelined.size() + streamed.size();
+}
+
+size_t ModbusTcpTransport::unmatchedCount() {
+    lock_guard<mutex> lock(stateMutex);
+    return unmatched;
+}
+
+TransactResult ModbusTcpTransport::transact(const uint8_t* request, size_t length, ReplySpec reply, chrono::steady_clock::time_point deadline) {
+    auto remaining = chrono::ceil<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+    if (remaining <= 0) return TransactResult::NotSent;
+    
+    int transactionId = submit(request, length);
+    if (transactionId < 0) return TransactResult::NotSent;
+    
+    uint8_t frame[256];
+    int n = awaitReply(static_cast<uint16_t>(transactionId), frame, sizeof(frame), static_cast<int>(remaining));
+    // ADU собран целиком, паузы внутри него для разбора не важны
+    if (n > 0 && reply.consume(reply.context, frame, static_cast<size_t>(n), chrono::steady_clock::now())) {
+        return TransactResult::Replied;
+    }
+    return TransactResult::NoReply;
+}
@@ -7,4 +7,62 @@
 
 #include "ModbusUtils.hpp"
 
+// MARK: Проверка CRC на этапе компиляции
 
+namespace {
+
+constexpr uint8_t readHolding[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+constexpr uint8_t specExample[] = { 0x11, 0x03, 0x00, 0x6B, 0x00, 0x03 };
+
+// Известные векторы (CRC передается младшим байтом вперед)
+static_assert(ModbusUtils::calculateCRCTable(readHolding, sizeof(readHolding)) == 0xCDC5, "CRC: 01 03 00 00 00 0A -> C5 CD");
+static_assert(ModbusUtils::calculateCRCTable(specExample, sizeof(specExample)) == 0x8776, "CRC: 11 03 00 6B 00 03 -> 76 87");
+static_assert(ModbusUtils::calculateCRCBitwise(specExample, sizeof(specExample)) == 0x8776, "Побитовый расчет разошелся с эталоном");
+
+constexpr bool sameFrame(const ModbusFrame::Buffer& frame, const ModbusFrame::Buffer& expected) {
+    for (size_t i = 0; i < frame.size(); i++) {
+        if (frame[i] != expected[i]) return false;
+    }
+    return true;
+}
+
+static_assert(sameFrame(OpenGateFrame::forAddress(0x01), { 0x01, 0x05, 0x00, 0x00, 0xFF, 0x00, 0x8C, 0x3A }), "OPEN для slave 1");
+static_assert(sameFrame(ReadPositionFrame::forAddress(0x01), { 0x01, 0x04, 0x00, 0x00, 0x00, 0x01, 0x31, 0xCA }), "IR0 для slave 1");
+static_assert(sameFrame(OpenGateFrame::bySlave[0x00], { 0x00, 0x05, 0x00, 0x00, 0xFF, 0x00, 0x8D, 0xEB }), "OPEN для slave 0");
+static_assert(sameFrame(CloseGateFrame::bySlave[0x00], { 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0xCC, 0x1B }), "CLOSE для slave 0");
+static_assert(sameFrame(ReadClosedFrame::bySlave[0x00], { 0x00, 0x02, 0x00, 0x01, 0x00, 0x08, 0x29, 0xDD }), "DI1 для slave 0");
+static_assert(sameFrame(ReadOpenedFrame::bySlave[0x00], { 0x00, 0x02, 0x00, 0x02, 0x00, 0x08, 0xD9, 0xDD }), "DI2 для slave 0");
+static_assert(sameFrame(ReadLimitsFrame::bySlave[0x00], { 0x00, 0x02, 0x00, 0x01, 0x00, 0x02, 0xA9, 0xDA }), "DI1+DI2 для slave 0");
+static_assert(sameFrame(ReadPositionFrame::bySlave[0x00], { 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x30, 0x1B }), "IR0 для slave 0");
+
+}
+
+uint16_t ModbusUtils::calculateCRCSlice4(const uint8_t* data, size_t length) {
+    const auto& t = crcTables;
+    uint16_t crc = 0xFFFF;
+    
+    while (length >= 4) {
+        // Первые два байта смешиваем с текущим CRC, остальные идут как есть
+        crc ^= data[0] | (data[1] << 8);
+        crc = t[3][crc & 0xFF] ^ t[2][crc >> 8] ^ t[1][data[2]] ^ t[0][data[3]];
+        data += 4;
+        length -= 4;
+    }
+    
+    return calculateCRCTable(data, length, crc);
+}
+
+uint16_t ModbusUtils::calculateCRCSlice8(const uint8_t* data, size_t length) {
+    const auto& t = crcTables;
+    uint16_t crc = 0xFFFF;
+    
+    while (length >= 8) {
+        crc ^= data[0] | (data[1] << 8);
+        crc = t[7][crc & 0xFF] ^ t[6][crc >> 8] ^ t[5][data[2]] ^ t[4][data[3]]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+    
+    return calculateCRCTable(data, length, crc);
+}
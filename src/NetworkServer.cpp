@@ -6,6 +6,7 @@
 //
 
 #include "NetworkServer.hpp"
+#include "ApiResponses.hpp"
 #include <iostream>
 #include <future>
 #include <memory>
@@ -13,7 +14,7 @@
 using namespace std;
 using json = nlohmann::json;
 
-NetworkServer::NetworkServer(GateController& gc, Database& db, const string& key): controller(gc), db(db), apiKey(key) {
+NetworkServer::NetworkServer(GateController& gc, GateStateCache& cache, GateCommandQueue& queue, Database& db, const string& key): controller(gc), gateCache(cache), commands(queue), db(db), apiKey(key) {
 }
 
 void NetworkServer::start(int port) {
@@ -27,21 +28,20 @@ void NetworkServer::start(int port) {
         
         // MARK: REST API
         app.get("/status", [this](auto* res, auto* req) {
-            bool isOpen = controller.isGateOpen();
-            
-            json response;
-            response["device_id"] = 0;
-            response["status"] = isOpen ? "open" : "closed";
-            response["timestamp"] = time(nullptr);
-            
-            int percent = this->controller.getGatePosition();
+            // Шину не трогаем: снимок от опросчика. ?max_age_ms= - своя граница свежести
+            chrono::milliseconds maxAge = statusMaxAge;
+            string_view maxAgeParam = req->getQuery("max_age_ms");
+            if (!maxAgeParam.empty()) {
+                maxAge = chrono::milliseconds(atoi(string(maxAgeParam).c_str()));
+            }
             
-            if (percent >= 0) {
-                response["position"] = percent;
-            } else {
-                response["position"] = nullptr;
+            GateSnapshot snapshot = gateCache.snapshot();
+            bool stale = snapshot.polls == 0 || snapshot.age() > maxAge;
+            if (stale) {
+                gateCache.requestRefresh();
             }
-                        
+            json response = ApiResponses::status(snapshot, 0, stale);
+            
             res->writeHeader("Content-Type", "application/json");
             res->end(response.dump());
         });
@@ -57,61 +57,51 @@ void NetworkServer::start(int port) {
             string authToken = string(req->getHeader("authorization"));
             
             if (authToken.find(this->apiKey) == string::npos) {
-                json response;
-                response["ok"] = false;
-                res->writeStatus("401 Unauthorized")->writeHeader("Content-Type", "application/json")->end(response.dump());
+                res->writeStatus("401 Unauthorized")->writeHeader("Content-Type", "application/json")->end(ApiResponses::unauthorized().dump());
                 return;
             }
             
-            thread([this]() {
-                try {
-                    this->controller.openGate();
-                } catch (const exception& e) {
-                    // Отлавливаем ошибки
-                    cerr << "Ошибка: " << e.what();
-                }
-            }).detach();
+            gateCommand(res, req, GateCommand::Open);
+        });
+        
+        app.post("/close", [this](auto* res, auto* req) {
+            string authToken = string(req->getHeader("authorization"));
             
-            json response;
-            response["ok"] = true;
-            response["status"] = "accepted";
+            if (authToken.find(this->apiKey) == string::npos) {
+                res->writeStatus("401 Unauthorized")->writeHeader("Content-Type", "application/json")->end(ApiResponses::unauthorized().dump());
+                return;
+            }
             
-            res->writeHeader("Content-Type", "application/json")->end(response.dump());
+            gateCommand(res, req, GateCommand::Close);
         });
         
-        app.post("/close", [this](auto* res, auto* req) {
+        app.post("/group/open", [this](auto* res, auto* req) {
             string authToken = string(req->getHeader("authorization"));
             
             if (authToken.find(this->apiKey) == string::npos) {
-                json response;
-                response["ok"] = false;
-                res->writeStatus("401 Unauthorized")->writeHeader("Content-Type", "application/json")->end(response.dump());
+                res->writeStatus("401 Unauthorized")->writeHeader("Content-Type", "application/json")->end(ApiResponses::unauthorized().dump());
                 return;
             }
             
-            thread([this]() {
-                try {
-                    this->controller.closeGate();
-                } catch (const exception& e) {
-                    // Отлавливаем ошибки
-                    cerr << "Ошибка: " << e.what();
-                }
-            }).detach();
+            groupCommand(res, GateCommand::Open);
+        });
+        
+        app.post("/group/close", [this](auto* res, auto* req) {
+            string authToken = string(req->getHeader("authorization"));
             
-            json response;
-            response["ok"] = true;
-            response["status"] = "accepted";
+            if (authToken.find(this->apiKey) == string::npos) {
+                res->writeStatus("401 Unauthorized")->writeHeader("Content-Type", "application/json")->end(ApiResponses::unauthorized().dump());
+                return;
+            }
             
-            res->writeHeader("Content-Type", "application/json")->end(response.dump());
+            groupCommand(res, GateCommand::Close);
         });
         
         app.post("/rfid/user", [this](auto* res, auto* req) {
             string authToken = string(req->getHeader("authorization"));
             
             if (authToken.find(this->apiKey) == string::npos) {
-                json response;
-                response["ok"] = false;
-                res->writeStatus("401 Unauthorized")->writeHeader("Content-Type", "application/json")->end(response.dump());
+                res->writeStatus("401 Unauthorized")->writeHeader("Content-Type", "application/json")->end(ApiResponses::unauthorized().dump());
                 return;
             }
             
@@ -182,18 +172,73 @@ void NetworkServer::start(int port) {
 void NetworkServer::broadcastEvent(const string& eventType, const json& data) {
     if (!loop || !globalApp) return;
     
-    json payload;
-    payload["event"] = eventType;
-    payload["data"] = data;
-    payload["timestamp"] = time(nullptr);
-    
-    string message = payload.dump();
+    string message = ApiResponses::event(eventType, data).dump();
     
     loop->defer([this, message]() {
         this->globalApp->publish("broadcast", message, uWS::OpCode::TEXT, false);
     });
 }
 
+void NetworkServer::gateCommand(uWS::HttpResponse<false>* res, uWS::HttpRequest* req, GateCommand command) {
+    bool wait = req->getQuery("wait") == "1";
+    
+    if (!wait) {
+        // Отвечаем сразу, исход - в websocket
+        bool queued = commands.submit(command, [this](const GateCommandResult& result) {
+            broadcastEvent("GATE_COMMAND", ApiResponses::commandResult(result));
+        });
+        if (!queued) {
+            res->writeStatus("429 Too Many Requests")->writeHeader("Retry-After", "1")->writeHeader("Content-Type", "application/json")->end(ApiResponses::busy(commands.depth()).dump());
+            return;
+        }
+        res->writeHeader("Content-Type", "application/json")->end(ApiResponses::accepted().dump());
+        return;
+    }
+    
+    // Ответ пишем из потока uWS, когда очередь сообщит исход. Клиент мог уйти раньше
+    auto aborted = make_shared<bool>(false);
+    res->onAborted([aborted]() {
+        *aborted = true;
+    });
+    
+    commands.submit(command, [this, res, aborted](const GateCommandResult& result) {
+        string body = ApiResponses::commandResult(result).dump();
+        const char* status = "200 OK";
+        switch (result.outcome) {
+            case GateCommandOutcome::Rejected: status = "429 Too Many Requests"; break;
+            case GateCommandOutcome::Failed: status = "502 Bad Gateway"; break;
+            case GateCommandOutcome::Cancelled: status = "503 Service Unavailable"; break;
+            default: break;
+        }
+        
+        bool rejected = result.outcome == GateCommandOutcome::Rejected;
+        loop->defer([res, aborted, status, body, rejected]() {
+            if (*aborted) return;
+            res->writeStatus(status);
+            // Как и без wait: очередь полна - клиенту говорим, когда повторить
+            if (rejected) res->writeHeader("Retry-After", "1");
+            res->writeHeader("Content-Type", "application/json")->end(body);
+        });
+    });
+}
+
+void NetworkServer::groupCommand(uWS::HttpResponse<false>* res, GateCommand command) {
+    if (!group) {
+        res->writeStatus("404 Not Found")->writeHeader("Content-Type", "application/json")->end(ApiResponses::noGroup().dump());
+        return;
+    }
+    
+    // Ждать концевиков всех шлагбаумов в потоке uWS нельзя - команда в потоке группы
+    bool queued = group->submit(command, [this](const GateGroupResult& result) {
+        broadcastEvent("GROUP_COMMAND", ApiResponses::groupResult(result));
+    });
+    if (!queued) {
+        res->writeStatus("429 Too Many Requests")->writeHeader("Retry-After", "1")->writeHeader("Content-Type", "application/json")->end(ApiResponses::groupBusy().dump());
+        return;
+    }
+    res->writeHeader("Content-Type", "application/json")->end(ApiResponses::accepted().dump());
+}
+
 void NetworkServer::postJSON(uWS::HttpResponse<false>* res, JSONHandler handler) {
     res->onAborted([]() {
         cout << "[uWS] Обрыв соединения\n";
@@ -6,11 +6,60 @@
 //
 
 #include "ParkingSystem.hpp"
+#include "ApiResponses.hpp"
 #include <iostream>
+#include <cctype>
 
 using namespace std;
 
-ParkingSystem::ParkingSystem(): db("parking_01.db"), controller(gatePort, 0), networkServer(controller, db, "secret_password_123") {
+// Параметры линии из конфига: <prefix>_baud, <prefix>_parity, ... (prefix - serial или rfid)
+static SerialSettings loadSerialSettings(ConfigLoader& config, const string& prefix) {
+    SerialSettings settings;
+    settings.baudRate = config.getInt(prefix + "_baud", settings.baudRate);
+    settings.dataBits = config.getInt(prefix + "_data_bits", settings.dataBits);
+    settings.stopBits = config.getInt(prefix + "_stop_bits", settings.stopBits);
+    
+    string parity = config.getString(prefix + "_parity", "N");
+    settings.parity = parity.empty() ? 'N' : static_cast<char>(toupper(parity[0]));
+    
+    settings.rs485 = config.getInt(prefix + "_rs485", 0) != 0;
+    settings.rs485DelayBeforeSendMs = config.getInt(prefix + "_rs485_delay_before_ms", 0);
+    settings.rs485DelayAfterSendMs = config.getInt(prefix + "_rs485_delay_after_ms", 0);
+    
+    settings.vmin = config.getInt(prefix + "_vmin", settings.vmin);
+    settings.vtime = config.getInt(prefix + "_vtime", settings.vtime);
+    return settings;
+}
+
+// Планирование потока шины: <prefix>_rt_policy (other/fifo/rr), _rt_priority, _rt_cpu, _mlock
+static RealtimeSettings loadRealtimeSettings(ConfigLoader& config, const string& prefix) {
+    RealtimeSettings settings;
+    settings.policy = RealtimeSettings::parsePolicy(config.getString(prefix + "_rt_policy", "other"));
+    settings.priority = config.getInt(prefix + "_rt_priority", 50);
+    settings.cpu = config.getInt(prefix + "_rt_cpu", -1);
+    settings.lockMemory = config.getInt(prefix + "_mlock", 0) != 0;
+    return settings;
+}
+
+// Список slave ID через запятую: "2,3"
+static vector<uint8_t> loadSlaveIds(ConfigLoader& config, const string& key) {
+    vector<uint8_t> ids;
+    string list = config.getString(key, "");
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos) end = list.size();
+        string item = list.substr(start, end - start);
+        if (item.find_first_of("0123456789") != string::npos) {
+            int id = atoi(item.c_str());
+            if (id >= 0 && id <= 247) ids.push_back(static_cast<uint8_t>(id));
+        }
+        start = end + 1;
+    }
+    return ids;
+}
+
+ParkingSystem::ParkingSystem(): db("parking_01.db"), gateBus(gateCapture), controller(gateBus.channel(0), 0), gateCache(controller), gateCommands(controller), networkServer(controller, gateCache, gateCommands, db, "secret_password_123") {
 }
 
 bool ParkingSystem::init(const string& configPath) {
@@ -26,17 +75,121 @@ bool ParkingSystem::init(const string& configPath) {
     
     // 2. Оборудования
     
-    // Шлагбаум
-    if (!gatePort.connect(gatePortName)) {
-        cerr << "Ошибка: Подключения к шлагбауму - " << gatePortName;
+    // Шлагбаум: serial (RS-485 напрямую) или TCP шлюз. Скорость линии за шлюзом - тоже serial_baud
+    SerialSettings gateSettings = loadSerialSettings(config, "serial");
+    string gateTransport = config.getString("gate_transport", "serial");
+    string gateAddress = config.getString("gate_address", gateTransport == "serial" ? gatePortName : "");
+    if (gateTransport == "serial") {
+        auto serial = make_unique<SerialPort>();
+        serial->configure(gateSettings);
+        gateSerial = serial.get();
+        gatePort = move(serial);
+    } else if (gateTransport == "tcp") {
+        gatePort = make_unique<ModbusTcpTransport>();
+    } else if (gateTransport == "rtu_tcp") {
+        gatePort = make_unique<RtuOverTcpTransport>();
+    } else if (gateTransport == "replay") {
+        // Сессия из файла захвата: шлагбаум отвечает записанным, карты приходят в записанные моменты
+        int speed = config.getInt("replay_speed", 1);
+        gatePort = make_unique<ReplayTransport>(speed);
+        rfidReplay = make_unique<CapturePlayer>(WireCapture::Channel::Rfid, speed);
+        if (!rfidReplay->load(gateAddress)) {
+            return false;
+        }
+    } else {
+        cerr << "Ошибка: gate_transport=" << gateTransport << " (нужно serial, tcp, rtu_tcp или replay)\n";
+        return false;
+    }
+    if (!gatePort->connect(gateAddress)) {
+        cerr << "Ошибка: Подключения к шлагбауму (" << gateTransport << ") - " << gateAddress;
         return false;
     }
-    gatePort.flush();
+    RealtimeSettings busRealtime = loadRealtimeSettings(config, "serial");
+    if (gateSerial) {
+        // Ответы шлагбаума принимаем в фоне: запоздавший ответ дождется в кольце,
+        // и фреймер отсеет его по адресу и функции, а не потеряет вместе с flush
+        gateSerial->setReceiverRealtime(busRealtime);
+        gateSerial->startReceiver();
+    }
+    gateBus.setRealtime(busRealtime);
+    gatePort->flush();
+    gateCapture.setPort(*gatePort);
+    
+    string capturePath = config.getString("capture_file");
+    if (!capturePath.empty()) {
+        gateCapture.start(capturePath);
+    }
+    
+    // Тайминги от скорости линии: t3.5 во фреймере и окно ответа (самый длинный наш обмен - 8 + 8 байт)
+    controller.setBaudRate(gateSettings.baudRate);
+    gateBus.setBaudRate(gateSettings.baudRate);
+    int replyTimeout = gateSettings.replyTimeoutMs(ModbusFrame::size, ModbusFrame::size, config.getInt("reply_processing_ms", 30));
+    controller.setReplyTimeout(config.getInt("reply_timeout_ms", replyTimeout));
+    // Окно ответа идет с выхода на линию, очередь шины ждет по своему бюджету
+    gateBus.setQueueTimeout(config.getInt("bus_queue_timeout_ms", 1000));
+    
+    // /status отдает снимок не старше этого, иначе помечает stale и просит внеочередной опрос
+    networkServer.setStatusMaxAge(chrono::milliseconds(config.getInt("status_max_age_ms", 2000)));
+    // Сколько разных команд может ждать своей очереди, дальше - 429
+    gateCommands.setMaxDepth(config.getInt("gate_queue_depth", 4));
+    // RFID открывает с автозакрытием: таймер на шлагбаум, новый проезд его продлевает
+    gateCommands.setAutoClose(timers, chrono::seconds(config.getInt("timeout_open_gate", 5)));
+    
+    // Датчик проезда (петля/фотоэлемент): закрываем по факту проезда, таймер - запасной
+    int vehicleSensor = config.getInt("vehicle_sensor_di", 0);
+    if (vehicleSensor != 0) {
+        controller.setVehicleSensor(vehicleSensor);
+        GateStateMachine::Timing timing = controller.states().timing();
+        timing.vehiclePoll = chrono::milliseconds(config.getInt("vehicle_poll_ms", 100));
+        controller.states().setTiming(timing);
+        gateCommands.setVehicleClose(chrono::milliseconds(config.getInt("vehicle_close_delay_ms", 1500)));
+    }
+    
+    // Колонна: разрешения чаще convoy_enter_per_min - держим открытым между машинами
+    ConvoySettings convoy;
+    convoy.enterPerMinute = config.getInt("convoy_enter_per_min", 0);
+    convoy.exitPerMinute = config.getInt("convoy_exit_per_min", 0);
+    convoy.window = chrono::seconds(config.getInt("convoy_window_s", 60));
+    convoy.hold = chrono::milliseconds(config.getInt("convoy_hold_ms", 10000));
+    convoy.vehiclePoll = chrono::milliseconds(config.getInt("convoy_vehicle_poll_ms", 0));
+    gateCommands.setConvoy(convoy);
+    
+    // Метрики полосы: цикл - от концевика открытия до концевика закрытия, проезд - датчик освободился
+    controller.states().addListener([this](GatePhase phase) {
+        if (phase == GatePhase::Open) lane.gateOpened();
+        else if (phase == GatePhase::Closed) lane.gateClosed();
+    });
+    controller.states().addVehicleListener([this](bool present) {
+        if (!present) lane.vehiclePassed();
+    });
+    
+    // Группа: остальные шлагбаумы этой линии командуются вместе с нашим (/group/open, /group/close).
+    // Broadcast - только если группа это вся линия (bus_slave_ids) и ни у кого нет ID 0
+    vector<uint8_t> groupIds = loadSlaveIds(config, "group_barrier_ids");
+    if (!groupIds.empty()) {
+        vector<GateController*> members = {&controller};
+        for (uint8_t id : groupIds) {
+            groupControllers.push_back(make_unique<GateController>(gateBus.channel(id), id));
+            groupControllers.back()->setBaudRate(gateSettings.baudRate);
+            groupControllers.back()->setReplyTimeout(config.getInt("reply_timeout_ms", replyTimeout));
+            members.push_back(groupControllers.back().get());
+        }
+        gateGroup = make_unique<GateGroup>(gateBus.channel(ModbusBroadcastAddress), members,
+                                           loadSlaveIds(config, "bus_slave_ids"), config.getInt("group_turnaround_ms", 50));
+        // У нашего шлагбаума своя очередь и автозакрытие, у остальных - нет
+        gateGroup->addQueue(gateCommands);
+        networkServer.setGroup(gateGroup.get());
+        cout << "[GateGroup] Шлагбаумов в группе: " << members.size()
+             << (gateGroup->usesBroadcast() ? ", команды broadcast" : ", команды по адресам") << "\n";
+    }
     
-    // RFID
-    if (!rfidReader.connect(rfidPortName)) {
+    // RFID. Его байты - в тот же захват, что и шлагбаум (канал Rfid)
+    if (rfidReplay) {
+        cout << "[Replay] Карт из " << gateAddress << ": " << rfidReplay->size() << " записей\n";
+    } else if (!rfidReader.connect(rfidPortName, loadSerialSettings(config, "rfid"))) {
         cerr << "Ошибка: Подключения к RFID - " << rfidPortName;
     }
+    rfidReader.setCapture(&gateCapture);
     
     // Beacon (маячок шлагбаума)
     beacon = make_unique<ServiceBeacon>(to_string(barrierId), httpPort, 30001);
@@ -74,7 +227,12 @@ void ParkingSystem::processRFIDCard(const string& cardCode) {
         db.logEvent("RFID", "Доступ получен для " + cardCode, config.getInt("barrier_id"));
         this->networkServer.broadcastEvent("RFID Scanned", { {"access", true}, {"card_code", cardCode} });
 
-        controller.openGate(true);
+        // Поток reactor не ждем - открытие в очереди команд
+        gateCommands.submit(GateCommand::Open, [](const GateCommandResult& result) {
+            if (!result.ok()) {
+                cerr << "[RFID] Ошибка открытия: " << result.error << "\n";
+            }
+        }, true);
     } else {
         cout << "[RFID] Нет доступа для - " << cardCode << "\n";
         db.logEvent("RFID", "Нет доступа для - " + cardCode, config.getInt("barrier_id"));
@@ -82,8 +240,42 @@ void ParkingSystem::processRFIDCard(const string& cardCode) {
     }
 }
 
+void ParkingSystem::pollGateState() {
+    // Выполняется в потоке reactor. Шину не трогает - снимок от опросчика
+    GateSnapshot snapshot = gateCache.snapshot();
+    int currentBarrierState = snapshot.state.position;
+    
+    if (currentBarrierState != lastBarrierState || snapshot.phase != lastPhase) {
+        networkServer.broadcastEvent("GATE_UPDATE", {
+            {"position", currentBarrierState},
+            {"phase", gatePhaseName(snapshot.phase)},
+            {"open", snapshot.state.isOpen},
+            {"closed", snapshot.state.isClosed}
+        });
+        lastBarrierState = currentBarrierState;
+        lastPhase = snapshot.phase;
+    }
+}
+
 void ParkingSystem::run() {
-    rfidReader.start();
+    // RFID слушает reactor. Обмены со шлагбаумом из любых потоков встают в очередь gateBus.
+    // В replay байты считывателя отдает таймер reactor - тот же поток, что и со считывателем
+    if (rfidReplay) {
+        rfidReplay->rewind();
+        reactor.addTimer(chrono::milliseconds(10), [this]() {
+            rfidReplay->playDue([this](const uint8_t* data, size_t length) { rfidReader.feed(data, length); });
+        });
+    } else {
+        rfidReader.attach(reactor);
+    }
+    
+    // Очередь команд - до сервера, чтобы первые /open не получили отказ
+    gateBus.start();
+    if (gateGroup) {
+        gateGroup->start(config.getInt("group_timeout_ms", 10000));
+    }
+    timers.start();
+    gateCommands.start();
     
     int httpPort = config.getInt("port_http");
     networkServer.start(httpPort);
@@ -93,23 +285,48 @@ void ParkingSystem::run() {
         beacon->start();
     }
     
-    // Проверяем изменилось ли состояние шлагбаума, если да пушим сообщения о позиции стрелы в websocket
-    int lastBarrierState = -1;
-    while (true) {
-        try {
-            int currentBarrierState = controller.getGatePosition();
-
-            if (currentBarrierState != lastBarrierState) {
-                networkServer.broadcastEvent("GATE_UPDATE", { {"position", currentBarrierState} });
-                lastBarrierState = currentBarrierState;
+    // Опрашивает шлагбаум только кеш: часто в движении, раз в секунду в покое
+    gateCache.start();
+    
+    // Проверяем изменилось ли состояние шлагбаума, если да пушим сообщения о позиции стрелы в websocket.
+    // Снимок читается без шины, поэтому можно чаще - видно движение стрелы
+    reactor.addTimer(chrono::milliseconds(250), [this]() {
+        pollGateState();
+    });
+    
+    // Пропускная способность полосы - в лог и websocket
+    int laneReportSeconds = config.getInt("lane_report_s", 60);
+    if (laneReportSeconds > 0) {
+        reactor.addTimer(chrono::seconds(laneReportSeconds), [this]() {
+            bool convoy = gateCommands.convoyActive();
+            cout << "[Lane] ";
+            lane.print(cout);
+            cout << (convoy ? ", колонна" : "") << "\n";
+            networkServer.broadcastEvent("LANE_METRICS", ApiResponses::laneMetrics(lane.stats(), convoy));
+        });
+    }
+    
+    // Опоздание пробуждения потока приема - видно, помогают ли serial_rt_* под нагрузкой
+    int latencyReportSeconds = config.getInt("serial_latency_report_s", 0);
+    if (latencyReportSeconds > 0 && gateSerial) {
+        reactor.addTimer(chrono::seconds(latencyReportSeconds), [this]() {
+            cout << "[Serial] Пробуждение приема: ";
+            gateSerial->wakeupLatency().print(cout);
+            cout << ", потеряно при переполнении кольца: " << gateSerial->overrunCount() << " байт\n";
+        });
+    }
+    
+    // Переполнение кольца приема - молча битые ответы, поэтому в лог сразу, как только растет
+    if (gateSerial) {
+        reactor.addTimer(chrono::seconds(1), [this]() {
+            size_t dropped = gateSerial->overrunCount();
+            if (dropped > reportedOverrun) {
+                cerr << "[Serial] Кольцо приема переполнено: потеряно " << dropped - reportedOverrun
+                     << " байт (всего " << dropped << ")\n";
+                reportedOverrun = dropped;
             }
-            
-        } catch (const exception e) {
-            cerr << "[MONITOR] Ошибка мониторинга состояния";
-        }
-        
-        this_thread::sleep_for(chrono::seconds(1));
+        });
     }
     
-    cin.get();
+    reactor.run();
 }
@@ -0,0 +1,69 @@
+//
+//  RealtimeThread.cpp
+//  Parking
+//
+
+#include "RealtimeThread.hpp"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+RealtimeSettings::Policy RealtimeSettings::parsePolicy(const string& name) {
+    if (name == "fifo" || name == "FIFO") return Policy::Fifo;
+    if (name == "rr" || name == "RR") return Policy::RoundRobin;
+    return Policy::Normal;
+}
+
+bool Realtime::applyToCurrentThread(const RealtimeSettings& settings, const string& threadName) {
+    bool ok = true;
+
+    if (settings.lockMemory) {
+        // На весь процесс, в том числе будущие аллокации
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            cerr << "[Realtime] " << threadName << ": mlockall не удался: " << strerror(errno) << "\n";
+            ok = false;
+        }
+    }
+
+    if (settings.cpu >= 0) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(settings.cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) {
+            cerr << "[Realtime] " << threadName << ": не закрепить за ядром " << settings.cpu << ": " << strerror(rc) << "\n";
+            ok = false;
+        }
+#else
+        // На macOS закрепления за ядром нет
+        cerr << "[Realtime] " << threadName << ": закрепление за ядром не поддерживается\n";
+        ok = false;
+#endif
+    }
+
+    if (settings.policy != RealtimeSettings::Policy::Normal) {
+        int policy = settings.policy == RealtimeSettings::Policy::Fifo ? SCHED_FIFO : SCHED_RR;
+        sched_param param = {};
+        param.sched_priority = settings.priority;
+        int rc = pthread_setschedparam(pthread_self(), policy, &param);
+        if (rc != 0) {
+            cerr << "[Realtime] " << threadName << ": приоритет " << settings.priority << " не выставлен: " << strerror(rc) << "\n";
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        cout << "[Realtime] " << threadName << ": "
+             << (settings.policy == RealtimeSettings::Policy::Fifo ? "SCHED_FIFO" :
+                 settings.policy == RealtimeSettings::Policy::RoundRobin ? "SCHED_RR" : "SCHED_OTHER")
+             << " " << settings.priority << ", ядро " << settings.cpu
+             << (settings.lockMemory ? ", память закреплена" : "") << "\n";
+    }
+    return ok;
+}
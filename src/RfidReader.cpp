@@ -6,3 +6,35 @@
 //
 
 #include "RfidReader.hpp"
+
+// Карта длиннее этого без перевода строки - мусор на линии
+static const size_t maxCardCodeLength = 64;
+
+bool RfidReader::attach(SerialReactor& reactor) {
+    return reactor.add(port.nativeHandle(), [this](const uint8_t* data, size_t length) {
+        if (capture) {
+            capture->record(WireCapture::Channel::Rfid, WireCapture::Direction::Rx, data, length);
+        }
+        feed(data, length);
+    });
+}
+
+void RfidReader::feed(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        char c = static_cast<char>(data[i]);
+        
+        if (c != '\n' && c != '\r') {
+            if (line.size() < maxCardCodeLength) {
+                line += c;
+            } else {
+                line.clear();
+            }
+            continue;
+        }
+        
+        if (!line.empty() && onCardRead) {
+            onCardRead(line);
+        }
+        line.clear();
+    }
+}
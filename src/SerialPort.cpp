@@ -7,20 +7,47 @@
 
 #include "SerialPort.hpp"
 #include "ICommunication.h"
+#include "FdWriter.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
+#include <cstring>
 #include <termios.h> // POSIX terminal control
 #include <unistd.h>
 #include <thread>
 
 using namespace std;
 
-SerialPort::SerialPort() : fileDescriptor(-1), isConnect(false) {}
+SerialPort::SerialPort() : fileDescriptor(-1), isConnect(false), rxDropped(0), receiving(false) {}
 
-SerialPort::~SerialPort() {}
+SerialPort::~SerialPort() {
+    stopReceiver();
+}
+
+// Стандартные скорости termios. 0 - такой константы нет
+static speed_t standardSpeed(int baudRate) {
+    switch (baudRate) {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+#ifdef B460800
+        case 460800: return B460800;
+#endif
+#ifdef B921600
+        case 921600: return B921600;
+#endif
+        default: return 0;
+    }
+}
 
 bool SerialPort::connect(const string& portName) {
     
@@ -39,39 +66,94 @@ bool SerialPort::connect(const string& portName) {
     
     if (tcgetattr(fileDescriptor, &tty) != 0) {
         // Тож ошибка
+        close(fileDescriptor);
+        fileDescriptor = -1;
         return false;
     }
     
-    // Скорость input и output
-    cfsetospeed(&tty, B9600);
-    cfsetispeed(&tty, B9600);
+    // Скорость input и output. Нестандартную выставим после tcsetattr
+    speed_t speed = standardSpeed(lineSettings.baudRate);
+    cfsetospeed(&tty, speed ? speed : B38400);
+    cfsetispeed(&tty, speed ? speed : B38400);
     
-    // 8 бит данных
-    tty.c_cflag &= ~PARENB;
-    tty.c_cflag &= ~CSTOPB;
+    // Биты данных
     tty.c_cflag &= ~CSIZE;
-    tty.c_cflag |= CS8;
+    switch (lineSettings.dataBits) {
+        case 5: tty.c_cflag |= CS5; break;
+        case 6: tty.c_cflag |= CS6; break;
+        case 7: tty.c_cflag |= CS7; break;
+        default: tty.c_cflag |= CS8; break;
+    }
+    
+    // Четность
+    tty.c_cflag &= ~(PARENB | PARODD);
+    if (lineSettings.parity == 'E') {
+        tty.c_cflag |= PARENB;
+    } else if (lineSettings.parity == 'O') {
+        tty.c_cflag |= PARENB | PARODD;
+    }
+    
+    // Стоп биты
+    if (lineSettings.stopBits == 2) {
+        tty.c_cflag |= CSTOPB;
+    } else {
+        tty.c_cflag &= ~CSTOPB;
+    }
+    
+    // Без модемных линий и аппаратного управления потоком
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~CRTSCTS;
     
     // Отключаем программное управление потоком
     tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+    // Кадры бинарные: никаких замен \r/\n и обрезки 8-го бита
+    tty.c_iflag &= ~(ICRNL | INLCR | IGNCR | ISTRIP | BRKINT | PARMRK);
+    tty.c_oflag &= ~OPOST;
     
     // Отключаем обработку спецсимволов (наример Ctrl+C)
-    tty.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
+    tty.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG | IEXTEN);
+    
+    tty.c_cc[VMIN] = static_cast<cc_t>(lineSettings.vmin);
+    tty.c_cc[VTIME] = static_cast<cc_t>(lineSettings.vtime);
     
     if (tcsetattr(fileDescriptor, TCSANOW, &tty) != 0) {
         // Ошибка настройки почему то не принялись
+        close(fileDescriptor);
+        fileDescriptor = -1;
+        return false;
+    }
+    
+    if (!speed && !setCustomBaudRate(lineSettings.baudRate)) {
+        cerr << "[SerialPort] Скорость " << lineSettings.baudRate << " не поддерживается портом\n";
+        close(fileDescriptor);
+        fileDescriptor = -1;
+        return false;
+    }
+    
+    if (lineSettings.rs485 && !applyRs485()) {
+        // Без RS-485 режима можно работать через конвертер с автопереключением, только предупреждаем
+        cerr << "[SerialPort] Не удалось включить RS-485 режим: " << strerror(errno) << "\n";
+    }
+    
+    // Порт остается неблокирующим: ожидание чтения - на poll, запись при полном буфере драйвера
+    // возвращает EAGAIN, и FdWriter ждет готовности только до дедлайна кадра
+    int flags = fcntl(fileDescriptor, F_GETFL);
+    if (flags == -1 || fcntl(fileDescriptor, F_SETFL, flags | O_NONBLOCK) == -1) {
+        cerr << "[SerialPort] Не удалось перевести порт в неблокирующий режим: " << strerror(errno) << "\n";
+        close(fileDescriptor);
+        fileDescriptor = -1;
         return false;
     }
     
     isConnect = true;
-    // Снимаем блокировку
-    fcntl(fileDescriptor, F_SETFL, 0);
     
-    std::cout << "Успешно подключились к: " << portName << std::endl;
+    std::cout << "Успешно подключились к: " << portName << " (" << lineSettings.baudRate << " "
+              << lineSettings.dataBits << lineSettings.parity << lineSettings.stopBits << ")" << std::endl;
     return true;
 }
 
 void SerialPort::disconnect() {
+    stopReceiver();
     if (isConnect && fileDescriptor != -1) {
         close(fileDescriptor);
         isConnect = false;
@@ -79,7 +161,13 @@ void SerialPort::disconnect() {
     }
 }
 
-bool SerialPort::sendBytes(const vector<uint8_t>& data) {
+bool SerialPort::sendBytes(const uint8_t* data, size_t length) {
+    ByteSpan part = {data, length};
+    auto deadline = chrono::steady_clock::now() + lineSettings.lineTime(length) + chrono::milliseconds(100);
+    return sendParts(&part, 1, deadline);
+}
+
+bool SerialPort::sendParts(const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline) {
     if (!isConnect) {
         return false;
     }
@@ -87,88 +175,238 @@ bool SerialPort::sendBytes(const vector<uint8_t>& data) {
     // блокируем поток
     lock_guard<mutex> lock(portMutex);
     
-    // кол-во записаных байт
-    ssize_t bytesWritte = write(fileDescriptor, data.data(), data.size());
-    
-    // если записали не столько сколько хотели, ошибка
-    if (bytesWritte != (ssize_t)data.size()) {
-        cout << "Ошибка, записалось не столько байт сколько ожидалось";
+    // Порт неблокирующий (O_NONBLOCK в connect): короткая запись и EAGAIN - не ошибка, дописываем до дедлайна
+    if (!FdWriter::writeParts(fileDescriptor, parts, count, deadline, false)) {
+        cerr << "[Serial] Не удалось записать кадр: " << strerror(errno) << "\n";
         return false;
     }
     
     return true;
 }
 
-int SerialPort::readBytes(vector<uint8_t>& buffer, int expectedLength, int timeoutSec) {
+int SerialPort::waitReadable(chrono::steady_clock::time_point deadline) {
+    while (true) {
+        // Округляем вверх, иначе последние доли миллисекунды превращаются в холостой цикл
+        auto remaining = chrono::ceil<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        if (remaining < 0) remaining = 0;
+        
+        struct pollfd pfd = {fileDescriptor, POLLIN, 0};
+        int result = poll(&pfd, 1, static_cast<int>(remaining));
+        
+        if (result < 0) {
+            // Прервали сигналом - ждем остаток до того же дедлайна
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (result == 0) {
+            return 0;
+        }
+        if (pfd.revents & (POLLERR | POLLNVAL)) {
+            return -1;
+        }
+        return 1;
+    }
+}
+
+int SerialPort::readBytesUntil(uint8_t* buffer, int expectedLength, chrono::steady_clock::time_point deadline) {
     if (!isConnect) {
         return -1;
     }
+    if (receiving) {
+        // Из кольца - общий цикл по readAvailable
+        return ICommunication::readBytesUntil(buffer, expectedLength, deadline);
+    }
     // блокируем поток
     lock_guard<mutex> lock(portMutex);
     
-    buffer.clear();
-    buffer.reserve(expectedLength);
-    
     int totalBytesRead = 0;
     
-    uint8_t tempBuffer[256];
-    
+    // Один дедлайн на весь кадр: байты, пришедшие по одному, не продлевают ожидание
     while (totalBytesRead < expectedLength) {
-        fd_set readfts;
-        FD_ZERO(&readfts);
-        FD_SET(fileDescriptor, &readfts);
-        
-        struct timeval timeout;
-        timeout.tv_sec = timeoutSec;
-        timeout.tv_usec = 0;
-        
-        // ждем пока придет ответ, или отваливаем по таймауту
-        int result = select(fileDescriptor + 1, &readfts, NULL, NULL, &timeout);
-        
-        if (result < 0) {
-            cout << "Ошибка в ACK\n";
-            return -1;
-        } 
+        int ready = waitReadable(deadline);
         
-        if (FD_ISSET(fileDescriptor, &readfts)) {
-            int bytesToRead = expectedLength - totalBytesRead;
-            if (bytesToRead > sizeof(tempBuffer)) bytesToRead = sizeof(tempBuffer);
-            
-            ssize_t n = read(fileDescriptor, tempBuffer, bytesToRead);
-            if (n > 0) {
-                buffer.insert(buffer.end(), tempBuffer, tempBuffer + n);
-                totalBytesRead += n;
-            } else {
-                break;
-            }
+        if (ready < 0) {
+            cout << "[SerialPort] Ошибка ожидания ответа: " << strerror(errno) << "\n";
+            return totalBytesRead > 0 ? totalBytesRead : -1;
+        }
+        if (ready == 0) {
+            // Таймаут - отдаем то что успели получить
+            break;
         }
         
+        // Читаем сразу в буфер вызывающего
+        ssize_t n = read(fileDescriptor, buffer + totalBytesRead, expectedLength - totalBytesRead);
+        if (n > 0) {
+            totalBytesRead += n;
+        } else if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        } else {
+            break;
+        }
     }
     
     return totalBytesRead;
+}
+
+int SerialPort::readAvailable(uint8_t* buffer, int capacity, int timeoutMs) {
+    if (!isConnect) {
+        return -1;
+    }
+    if (receiving) {
+        chrono::steady_clock::time_point arrivedAt;
+        return readFromRing(buffer, capacity, timeoutMs, arrivedAt);
+    }
+    lock_guard<mutex> lock(portMutex);
     
+    int ready = waitReadable(chrono::steady_clock::now() + chrono::milliseconds(timeoutMs));
+    if (ready <= 0) {
+        return ready;
+    }
+    
+    // poll сказал что данные есть, read вернет то что уже в буфере драйвера
+    ssize_t n = read(fileDescriptor, buffer, capacity);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return 0;
+    }
+    return n > 0 ? static_cast<int>(n) : -1;
 }
 
 void SerialPort::flush() {
-    lock_guard<mutex> lock(portMutex);
     if (fileDescriptor == -1) return;
     
-    int flags = fcntl(fileDescriptor, F_GETFL, 0);
-    fcntl(fileDescriptor, F_SETFL, flags | O_NONBLOCK);
+    // Без пауз: выбрасываем то что уже принято. Хвосты, которые придут позже,
+    // отсеет фреймер по паузе между кадрами и по CRC
+    size_t totalBytes = 0;
+    if (receiving) {
+        totalBytes = rxRing.clear();
+        rxConsumed += totalBytes;
+    } else {
+        lock_guard<mutex> lock(portMutex);
+        tcflush(fileDescriptor, TCIFLUSH);
+    }
     
-    uint8_t buffer[1024];
-    int totalBytes = 0;
-    int bytesRead = 0;
+    if (totalBytes > 0) {
+        cout << "[SerialPort] Очистка мусора " << totalBytes << " байт мусора.\n";
+    }
+}
+
+bool SerialPort::startReceiver() {
+    if (!isConnect || receiving) return false;
+    if (pipe(stopPipe) != 0) return false;
     
-    do {
-        bytesRead = read(fileDescriptor, buffer, sizeof(buffer));
-        if (bytesRead > 0) totalBytes += bytesRead;
-        if (bytesRead > 0) this_thread::sleep_for(chrono::milliseconds(10));
-    } while (bytesRead > 0);
+    receiving = true;
+    receiver = thread([this]() { receiveLoop(); });
+    return true;
+}
+
+void SerialPort::stopReceiver() {
+    if (!receiver.joinable()) return;
     
-    fcntl(fileDescriptor, F_SETFL, flags);
+    uint8_t stop = 1;
+    ssize_t n = write(stopPipe[1], &stop, 1);
+    (void)n;
+    receiver.join();
     
-    if (totalBytes > 0) {
-        cout << "[SerialPort] Очистка мусора " << totalBytes << " байт мусора.\n";
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    stopPipe[0] = stopPipe[1] = -1;
+}
+
+void SerialPort::receiveLoop() {
+    uint8_t chunk[256];
+    
+    if (receiverRealtime.enabled()) {
+        Realtime::applyToCurrentThread(receiverRealtime, "serial receiver");
+    }
+    
+    while (true) {
+        struct pollfd fds[2] = {
+            {fileDescriptor, POLLIN, 0},
+            {stopPipe[0], POLLIN, 0}
+        };
+        
+        auto wakeAt = chrono::steady_clock::now() + chrono::milliseconds(latencyProbeMs);
+        int result = poll(fds, 2, latencyProbeMs);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (result == 0) {
+            auto late = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - wakeAt).count();
+            wakeupHistogram.record(late > 0 ? static_cast<uint64_t>(late) : 0);
+            continue;
+        }
+        if (fds[1].revents & POLLIN) break;
+        if (fds[0].revents & (POLLERR | POLLNVAL)) break;
+        if (!(fds[0].revents & (POLLIN | POLLHUP))) continue;
+        
+        ssize_t n = read(fileDescriptor, chunk, sizeof(chunk));
+        // Время порции - сразу после read, до того как читатель до нее доберется
+        auto arrivedAt = chrono::steady_clock::now();
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) break;
+        
+        // Сначала байты, потом метка: читатель без метки возьмет время чтения, но байты не потеряет
+        size_t pushed = rxRing.push(chunk, static_cast<size_t>(n));
+        if (pushed > 0) {
+            rxWritten += pushed;
+            RxStamp stamp = {rxWritten, arrivedAt};
+            rxStamps.push(&stamp, 1);
+        }
+        // Остаток порции выброшен - ответ, в который он входил, уже битый
+        if (pushed < static_cast<size_t>(n)) {
+            rxDropped += static_cast<size_t>(n) - pushed;
+        }
+        
+        // Пустая критическая секция - чтобы читатель не проспал уведомление
+        { lock_guard<mutex> lock(rxMutex); }
+        rxReady.notify_one();
+    }
+    
+    {
+        lock_guard<mutex> lock(rxMutex);
+        receiving = false;
+    }
+    rxReady.notify_all();
+}
+
+int SerialPort::readChunk(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt) {
+    if (isConnect && receiving) {
+        return readFromRing(buffer, capacity, timeoutMs, arrivedAt);
+    }
+    return ICommunication::readChunk(buffer, capacity, timeoutMs, arrivedAt);
+}
+
+int SerialPort::readFromRing(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt) {
+    if (rxRing.empty()) {
+        unique_lock<mutex> lock(rxMutex);
+        rxReady.wait_for(lock, chrono::milliseconds(timeoutMs), [this]() {
+            return !rxRing.empty() || !receiving;
+        });
+    }
+    
+    // Метки порций, забранных целиком (или выброшенных flush), больше не нужны
+    RxStamp stamp;
+    bool stamped = false;
+    while (rxStamps.peek(stamp)) {
+        if (stamp.end > rxConsumed) {
+            stamped = true;
+            break;
+        }
+        rxStamps.pop(&stamp, 1);
+    }
+    
+    // Не дальше конца текущей порции: у следующей свое время
+    size_t limit = static_cast<size_t>(capacity);
+    if (stamped) limit = min(limit, stamp.end - rxConsumed);
+    
+    size_t n = rxRing.pop(buffer, limit);
+    rxConsumed += n;
+    arrivedAt = stamped ? stamp.at : chrono::steady_clock::now();
+    
+    if (n == 0 && !receiving) {
+        // Прием остановился (порт отвалился)
+        return -1;
     }
+    return static_cast<int>(n);
 }
@@ -0,0 +1,55 @@
+//
+//  SerialPortIoctl.cpp
+//  Parking
+//
+//  Платформенные ioctl порта. Отдельный файл: на Linux <asm/termbits.h>
+//  (termios2) нельзя подключать вместе с <termios.h>.
+//
+
+#include "SerialPort.hpp"
+#include <cerrno>
+#include <sys/ioctl.h>
+
+#ifdef __linux__
+#include <asm/termbits.h>
+#include <linux/serial.h>
+#elif defined(__APPLE__)
+#include <IOKit/serial/ioss.h>
+#endif
+
+using namespace std;
+
+bool SerialPort::setCustomBaudRate(int baudRate) {
+#ifdef __linux__
+    // termios2 + BOTHER: скорость задается числом, а не константой
+    struct termios2 tio;
+    if (ioctl(fileDescriptor, TCGETS2, &tio) != 0) return false;
+
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baudRate;
+    tio.c_ospeed = baudRate;
+
+    return ioctl(fileDescriptor, TCSETS2, &tio) == 0;
+#elif defined(__APPLE__)
+    speed_t speed = baudRate;
+    return ioctl(fileDescriptor, IOSSIOSPEED, &speed) == 0;
+#else
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+bool SerialPort::applyRs485() {
+#if defined(__linux__) && defined(TIOCSRS485)
+    struct serial_rs485 rs485 = {};
+    rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+    rs485.delay_rts_before_send = lineSettings.rs485DelayBeforeSendMs;
+    rs485.delay_rts_after_send = lineSettings.rs485DelayAfterSendMs;
+
+    return ioctl(fileDescriptor, TIOCSRS485, &rs485) == 0;
+#else
+    errno = ENOTSUP;
+    return false;
+#endif
+}
@@ -0,0 +1,223 @@
+//
+//  SerialReactor.cpp
+//  Parking
+//
+
+#include "SerialReactor.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#endif
+
+using namespace std;
+
+SerialReactor::SerialReactor() : running(false) {
+#ifdef __linux__
+    pollFd = epoll_create1(EPOLL_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wakeFds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = timerFd;
+    epoll_ctl(pollFd, EPOLL_CTL_ADD, timerFd, &event);
+    event.data.fd = wakeFds[0];
+    epoll_ctl(pollFd, EPOLL_CTL_ADD, wakeFds[0], &event);
+#else
+    if (pipe(wakeFds) == 0) {
+        fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+    }
+#endif
+}
+
+SerialReactor::~SerialReactor() {
+    stop();
+    for (int fd : {pollFd, timerFd, wakeFds[0], wakeFds[1]}) {
+        if (fd != -1) close(fd);
+    }
+}
+
+bool SerialReactor::add(int fd, ReadHandler handler) {
+    if (fd < 0) return false;
+#ifdef __linux__
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(pollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        cerr << "[Reactor] Не удалось добавить fd " << fd << ": " << strerror(errno) << "\n";
+        return false;
+    }
+#endif
+    handlers[fd] = move(handler);
+    return true;
+}
+
+void SerialReactor::remove(int fd) {
+#ifdef __linux__
+    epoll_ctl(pollFd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+    handlers.erase(fd);
+}
+
+int SerialReactor::addTimer(chrono::milliseconds interval, Task callback) {
+    int id = nextTimerId++;
+    timers.push_back({id, interval, chrono::steady_clock::now() + interval, move(callback)});
+    armTimer();
+    return id;
+}
+
+void SerialReactor::cancelTimer(int id) {
+    timers.erase(remove_if(timers.begin(), timers.end(), [id](const Timer& t) { return t.id == id; }), timers.end());
+    armTimer();
+}
+
+void SerialReactor::wakeup() {
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t n = write(wakeFds[0], &one, sizeof(one));
+#else
+    uint8_t one = 1;
+    ssize_t n = write(wakeFds[1], &one, sizeof(one));
+#endif
+    (void)n;
+}
+
+void SerialReactor::drainWakeup() {
+    uint8_t buffer[64];
+    while (read(wakeFds[0], buffer, sizeof(buffer)) > 0) {}
+}
+
+void SerialReactor::runTimers() {
+    auto now = chrono::steady_clock::now();
+
+    // Колбек может добавить или отменить таймер, поэтому идем по id, а не по итераторам
+    vector<int> due;
+    for (const auto& t : timers) {
+        if (t.next <= now) due.push_back(t.id);
+    }
+    for (int id : due) {
+        auto it = find_if(timers.begin(), timers.end(), [id](const Timer& t) { return t.id == id; });
+        if (it == timers.end()) continue;
+
+        // Следующий запуск от плана, а не от факта - без накопления дрейфа.
+        // Если проспали несколько периодов, не догоняем их пачкой
+        it->next += it->interval;
+        if (it->next <= now) it->next = now + it->interval;
+
+        Task callback = it->callback;
+        callback();
+    }
+    armTimer();
+}
+
+void SerialReactor::armTimer() {
+#ifdef __linux__
+    itimerspec spec = {};
+    if (!timers.empty()) {
+        auto next = min_element(timers.begin(), timers.end(), [](const Timer& a, const Timer& b) { return a.next < b.next; })->next;
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(next.time_since_epoch()).count();
+        // 0 снимает таймер, поэтому минимум 1 нс
+        if (ns <= 0) ns = 1;
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    }
+    // steady_clock на Linux - это CLOCK_MONOTONIC, можно задавать абсолютное время
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+#endif
+}
+
+int SerialReactor::nextTimeoutMs() const {
+    if (timers.empty()) return -1;
+
+    auto next = min_element(timers.begin(), timers.end(), [](const Timer& a, const Timer& b) { return a.next < b.next; })->next;
+    auto remaining = chrono::ceil<chrono::milliseconds>(next - chrono::steady_clock::now()).count();
+    return remaining > 0 ? static_cast<int>(remaining) : 0;
+}
+
+void SerialReactor::dispatch(int fd) {
+    auto it = handlers.find(fd);
+    if (it == handlers.end()) return;
+
+    // Порты неблокирующие (SerialPort::connect): если данные уже забрали, read вернет EAGAIN
+    uint8_t buffer[256];
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+
+    if (n > 0) {
+        it->second(buffer, static_cast<size_t>(n));
+    } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        // Порт отвалился - убираем, иначе цикл будет крутиться вхолостую
+        cerr << "[Reactor] Порт fd " << fd << " закрыт, снимаем с опроса\n";
+        remove(fd);
+    }
+}
+
+void SerialReactor::waitEvents() {
+#ifdef __linux__
+    epoll_event events[16];
+    int count = epoll_wait(pollFd, events, 16, -1);
+
+    if (count < 0) {
+        if (errno != EINTR) cerr << "[Reactor] epoll_wait: " << strerror(errno) << "\n";
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        if (fd == timerFd) {
+            uint64_t expirations;
+            ssize_t n = read(timerFd, &expirations, sizeof(expirations));
+            (void)n;
+            runTimers();
+        } else if (fd == wakeFds[0]) {
+            drainWakeup();
+        } else {
+            dispatch(fd);
+        }
+    }
+#else
+    vector<pollfd> fds;
+    fds.reserve(handlers.size() + 1);
+    fds.push_back({wakeFds[0], POLLIN, 0});
+    for (const auto& entry : handlers) {
+        fds.push_back({entry.first, POLLIN, 0});
+    }
+
+    int count = poll(fds.data(), static_cast<nfds_t>(fds.size()), nextTimeoutMs());
+
+    if (count < 0) {
+        if (errno != EINTR) cerr << "[Reactor] poll: " << strerror(errno) << "\n";
+        return;
+    }
+
+    if (fds[0].revents & POLLIN) drainWakeup();
+    for (size_t i = 1; i < fds.size(); i++) {
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) dispatch(fds[i].fd);
+    }
+    runTimers();
+#endif
+}
+
+void SerialReactor::run() {
+    running = true;
+    armTimer();
+
+    while (running) {
+        waitEvents();
+    }
+}
+
+void SerialReactor::stop() {
+    if (!running) return;
+    running = false;
+    wakeup();
+}
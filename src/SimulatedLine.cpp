@@ -0,0 +1,180 @@
+//
+//  SimulatedLine.cpp
+//  Parking
+//
+
+#include "SimulatedLine.hpp"
+#include <algorithm>
+
+using namespace std;
+
+// MARK: Линия
+
+SimulatedLine::SimulatedLine() : SimulatedLine(Options()) {}
+
+SimulatedLine::SimulatedLine(const Options& lineOptions)
+    : options(lineOptions), ends{Endpoint(*this, 0), Endpoint(*this, 1)}, rng(lineOptions.seed) {
+    symbolTime = chrono::microseconds(1000000LL * options.bitsPerChar / max(options.baudRate, 1));
+    txFreeAt[0] = txFreeAt[1] = virtualNow;
+}
+
+void SimulatedLine::transmit(int fromSide, const uint8_t* data, size_t length) {
+    // Передача начинается, когда линия свободна от прошлой посылки этого конца
+    Clock::time_point start = max(virtualNow, txFreeAt[fromSide]);
+
+    for (size_t i = 0; i < length; i++) {
+        Clock::time_point arrival = start + symbolTime * static_cast<int>(i + 1);
+        lineStats.bytesSent++;
+
+        if (options.lossRate > 0 && chance(rng) < options.lossRate) {
+            lineStats.bytesLost++;
+            continue;
+        }
+
+        uint8_t byte = data[i];
+        if (options.corruptionRate > 0 && chance(rng) < options.corruptionRate) {
+            byte ^= static_cast<uint8_t>(1u << (rng() % 8));
+            lineStats.bytesCorrupted++;
+        }
+
+        Event event;
+        event.at = arrival;
+        event.order = nextOrder++;
+        event.side = 1 - fromSide;
+        event.byte = byte;
+        events.push(move(event));
+    }
+
+    txFreeAt[fromSide] = start + symbolTime * static_cast<int>(length);
+}
+
+void SimulatedLine::schedule(Clock::time_point at, function<void()> action) {
+    Event event;
+    event.at = max(at, virtualNow);
+    event.order = nextOrder++;
+    event.action = move(action);
+    events.push(move(event));
+}
+
+bool SimulatedLine::step(Clock::time_point until) {
+    if (events.empty() || events.top().at > until) return false;
+
+    Event event = events.top();
+    events.pop();
+    virtualNow = max(virtualNow, event.at);
+
+    if (event.action) {
+        event.action();
+        return true;
+    }
+
+    Endpoint& target = ends[event.side];
+    if (!target.listeners.empty()) {
+        for (auto& listener : target.listeners) listener(event.byte);
+    } else {
+        target.inbox.push_back(event.byte);
+    }
+    return true;
+}
+
+void SimulatedLine::advance(chrono::microseconds duration) {
+    Clock::time_point until = virtualNow + duration;
+    while (step(until)) {}
+    virtualNow = until;
+}
+
+// MARK: Концы линии
+
+bool SimulatedLine::Endpoint::sendBytes(const uint8_t* data, size_t length) {
+    line.transmit(side, data, length);
+    return true;
+}
+
+int SimulatedLine::Endpoint::readAvailable(uint8_t* buffer, int capacity, int timeoutMs) {
+    Clock::time_point deadline = line.virtualNow + chrono::milliseconds(timeoutMs);
+
+    // Время идет до первого байта, дальше забираем только то, что пришло к этому моменту
+    while (inbox.empty()) {
+        if (!line.step(deadline)) {
+            line.virtualNow = max(line.virtualNow, deadline);
+            return 0;
+        }
+    }
+    while (line.step(line.virtualNow)) {}
+
+    int n = min<int>(capacity, static_cast<int>(inbox.size()));
+    copy_n(inbox.begin(), n, buffer);
+    inbox.erase(inbox.begin(), inbox.begin() + n);
+    return n;
+}
+
+int SimulatedLine::Endpoint::readChunk(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt) {
+    int n = readAvailable(buffer, capacity, timeoutMs);
+    arrivedAt = line.virtualNow;
+    return n;
+}
+
+TransactResult SimulatedLine::Endpoint::transact(const uint8_t* request, size_t length, ReplySpec reply, chrono::steady_clock::time_point deadline) {
+    BusTurn turn(*this);
+
+    // Базовый transact ждет по реальным часам, а здесь реального ожидания нет:
+    // тот же бюджет отсчитываем по виртуальным
+    auto budget = chrono::duration_cast<chrono::microseconds>(deadline - chrono::steady_clock::now());
+    if (budget.count() <= 0) return TransactResult::NotSent;
+    Clock::time_point virtualDeadline = line.virtualNow + budget;
+
+    turn.staleBytes += inbox.size();
+    inbox.clear();
+
+    if (!sendBytes(request, length)) return TransactResult::NotSent;
+
+    uint8_t chunk[64];
+    while (line.virtualNow < virtualDeadline) {
+        auto remaining = chrono::ceil<chrono::milliseconds>(virtualDeadline - line.virtualNow).count();
+        Clock::time_point arrivedAt;
+        int n = readChunk(chunk, sizeof(chunk), static_cast<int>(remaining), arrivedAt);
+        if (n > 0 && reply.consume(reply.context, chunk, n, arrivedAt)) {
+            turn.done = true;
+            return TransactResult::Replied;
+        }
+    }
+    return TransactResult::NoReply;
+}
+
+bool SimulatedLine::Endpoint::broadcast(const uint8_t* request, size_t length, chrono::milliseconds turnaround) {
+    BusTurn turn(*this);
+
+    turn.staleBytes += inbox.size();
+    inbox.clear();
+
+    if (!sendBytes(request, length)) return false;
+    // Кадр доходит до slave, дальше они выполняют команду молча
+    line.advance(line.symbolTime * static_cast<int>(length) + turnaround);
+    turn.done = true;
+    return true;
+}
+
+// MARK: Шлагбаум на линии
+
+SimulatedBarrier::SimulatedBarrier(SimulatedLine& simulatedLine, uint8_t slaveId, int travelTimeMs, chrono::microseconds latency)
+    : line(simulatedLine), model(slaveId, travelTimeMs),
+      framer(simulatedLine.baudRate(), ModbusRtuFramer::Direction::Request), replyLatency(latency) {
+    line.slave().addListener([this](uint8_t byte) { onByte(byte); });
+}
+
+void SimulatedBarrier::onByte(uint8_t byte) {
+    framer.feed(&byte, 1, line.now());
+
+    ModbusRtuFrame request;
+    while (framer.nextFrame(request)) {
+        requests++;
+        size_t length = model.handleRtu(request.data, request.length, reply, line.now());
+        if (length == 0) continue;
+
+        // Ответ уходит после обработки в контроллере шлагбаума
+        vector<uint8_t> answer(reply, reply + length);
+        line.schedule(line.now() + replyLatency, [this, answer]() {
+            line.slave().sendBytes(answer.data(), answer.size());
+        });
+    }
+}
@@ -0,0 +1,152 @@
+//
+//  TcpTransport.cpp
+//  Parking
+//
+
+#include "TcpTransport.hpp"
+#include "FdWriter.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// На macOS нет MSG_NOSIGNAL, там SIGPIPE отключается опцией сокета
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+
+TcpTransport::TcpTransport(int timeoutMs) : socketFd(-1), connectTimeoutMs(timeoutMs) {}
+
+TcpTransport::~TcpTransport() {
+    disconnect();
+}
+
+bool TcpTransport::connect(const string& address) {
+    size_t separator = address.rfind(':');
+    if (separator == string::npos) {
+        cerr << "[TCP] Адрес должен быть в формате host:port - " << address << "\n";
+        return false;
+    }
+    string host = address.substr(0, separator);
+    string port = address.substr(separator + 1);
+    
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+        cerr << "[TCP] Не получилось разрешить адрес " << address << "\n";
+        return false;
+    }
+    
+    for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) continue;
+        
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        
+        // Кадры маленькие, Nagle только добавит задержку
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+#ifdef SO_NOSIGPIPE
+        int noSigPipe = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+        
+        int rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc != 0 && errno == EINPROGRESS) {
+            pollfd pfd = { fd, POLLOUT, 0 };
+            if (poll(&pfd, 1, connectTimeoutMs) == 1) {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+                rc = error == 0 ? 0 : -1;
+            }
+        }
+        
+        if (rc == 0) {
+            socketFd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(result);
+    
+    if (socketFd == -1) {
+        cerr << "[TCP] Не получилось подключиться к " << address << "\n";
+        return false;
+    }
+    
+    cout << "[TCP] Подключились к: " << address << "\n";
+    return true;
+}
+
+void TcpTransport::disconnect() {
+    if (socketFd != -1) {
+        close(socketFd);
+        socketFd = -1;
+        cout << "[TCP] Отключились.\n";
+    }
+}
+
+void TcpTransport::flush() {
+    lock_guard<mutex> lock(recvMutex);
+    uint8_t buffer[1024];
+    while (readSome(buffer, sizeof(buffer), 0) > 0) {}
+}
+
+bool TcpTransport::waitFor(short events, int timeoutMs) {
+    pollfd pfd = { socketFd, events, 0 };
+    int rc = poll(&pfd, 1, timeoutMs);
+    return rc == 1 && (pfd.revents & (events | POLLHUP | POLLERR));
+}
+
+bool TcpTransport::writeAll(const uint8_t* data, size_t length, int timeoutMs) {
+    ByteSpan part = {data, length};
+    return writeParts(&part, 1, chrono::steady_clock::now() + chrono::milliseconds(timeoutMs));
+}
+
+bool TcpTransport::writeParts(const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline) {
+    return FdWriter::writeParts(socketFd, parts, count, deadline, true);
+}
+
+int TcpTransport::readSome(uint8_t* buffer, size_t capacity, int timeoutMs) {
+    if (socketFd == -1) return -1;
+    
+    ssize_t n = recv(socketFd, buffer, capacity, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        if (timeoutMs <= 0 || !waitFor(POLLIN, timeoutMs)) return 0;
+        n = recv(socketFd, buffer, capacity, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    }
+    
+    // 0 - удаленная сторона закрыла соединение
+    return n > 0 ? static_cast<int>(n) : -1;
+}
+
+// MARK: RTU over TCP
+
+bool RtuOverTcpTransport::sendBytes(const uint8_t* data, size_t length) {
+    lock_guard<mutex> lock(sendMutex);
+    return writeAll(data, length, connectTimeoutMs);
+}
+
+bool RtuOverTcpTransport::sendParts(const ByteSpan* parts, size_t count, chrono::steady_clock::time_point deadline) {
+    lock_guard<mutex> lock(sendMutex);
+    return writeParts(parts, count, deadline);
+}
+
+int RtuOverTcpTransport::readAvailable(uint8_t* buffer, int capacity, int timeoutMs) {
+    lock_guard<mutex> lock(recvMutex);
+    return readSome(buffer, capacity, timeoutMs);
+}
@@ -0,0 +1,195 @@
+//
+//  TimerWheel.cpp
+//  Parking
+//
+
+#include "TimerWheel.hpp"
+#include <iostream>
+
+using namespace std;
+
+TimerWheel::TimerWheel(chrono::milliseconds tickDuration) : tick(tickDuration), origin(Clock::now()) {
+}
+
+TimerWheel::~TimerWheel() {
+    stop();
+}
+
+void TimerWheel::start() {
+    if (running) return;
+    running = true;
+    worker = thread([this]() { workerLoop(); });
+}
+
+void TimerWheel::stop() {
+    if (!running) return;
+    {
+        lock_guard<mutex> lock(wheelMutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+uint64_t TimerWheel::tickFor(Clock::time_point at) const {
+    if (at <= origin) return 0;
+    return static_cast<uint64_t>((at - origin) / tick);
+}
+
+TimerWheel::Slot& TimerWheel::slotFor(uint64_t expiry) {
+    uint64_t delta = expiry > currentTick ? expiry - currentTick : 0;
+
+    for (int level = 0; level < levels; level++) {
+        if (delta < (1ULL << (slotBits * (level + 1)))) {
+            return wheel[level][(expiry >> (slotBits * level)) & slotMask];
+        }
+    }
+    // Дальше всего колеса - в последнюю ячейку старшего уровня, при пересыпании встанет заново
+    uint64_t farthest = currentTick + (1ULL << (slotBits * levels)) - 1;
+    return wheel[levels - 1][(farthest >> (slotBits * (levels - 1))) & slotMask];
+}
+
+uint64_t TimerWheel::expiryFor(chrono::milliseconds delay) {
+    Clock::time_point at = Clock::now() + delay;
+
+    // Пока таймеров нет, колесо стоит - догоняем часы, пересыпать нечего
+    if (index.empty()) {
+        currentTick = max(currentTick, tickFor(Clock::now()));
+    }
+    // Не раньше срока: округляем вверх, и не в текущий тик - он уже разобран
+    uint64_t expiry = tickFor(at);
+    if (origin + tick * expiry < at) expiry++;
+    return max(expiry, currentTick + 1);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(chrono::milliseconds delay, Task task) {
+    TimerId id;
+    {
+        lock_guard<mutex> lock(wheelMutex);
+        id = nextId++;
+        uint64_t expiry = expiryFor(delay);
+
+        Slot& slot = slotFor(expiry);
+        slot.push_back({id, expiry, move(task)});
+        index[id] = {&slot, prev(slot.end())};
+    }
+    wake.notify_one();
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    lock_guard<mutex> lock(wheelMutex);
+    auto it = index.find(id);
+    if (it == index.end()) return false;
+
+    it->second.slot->erase(it->second.entry);
+    index.erase(it);
+    return true;
+}
+
+bool TimerWheel::reschedule(TimerId id, chrono::milliseconds delay) {
+    {
+        lock_guard<mutex> lock(wheelMutex);
+        auto it = index.find(id);
+        if (it == index.end()) return false;
+
+        Location& location = it->second;
+        location.entry->expiry = expiryFor(delay);
+        place(*location.slot, location.entry);
+    }
+    wake.notify_one();
+    return true;
+}
+
+bool TimerWheel::isPending(TimerId id) const {
+    lock_guard<mutex> lock(wheelMutex);
+    return index.count(id) != 0;
+}
+
+size_t TimerWheel::pending() const {
+    lock_guard<mutex> lock(wheelMutex);
+    return index.size();
+}
+
+void TimerWheel::place(Slot& from, Slot::iterator entry) {
+    // splice не трогает сам узел - итератор в index остается верным
+    Slot& to = slotFor(entry->expiry);
+    to.splice(to.end(), from, entry);
+    index[entry->id].slot = &to;
+}
+
+void TimerWheel::cascade(int level) {
+    Slot moving;
+    moving.swap(wheel[level][(currentTick >> (slotBits * level)) & slotMask]);
+    while (!moving.empty()) {
+        place(moving, moving.begin());
+    }
+}
+
+void TimerWheel::collect(uint64_t target, vector<Task>& due) {
+    while (currentTick < target) {
+        currentTick++;
+
+        // Младшее колесо прошло круг - пересыпаем следующую ячейку старшего, и так вверх
+        for (int level = 1; level < levels; level++) {
+            if ((currentTick & ((1ULL << (slotBits * level)) - 1)) != 0) break;
+            cascade(level);
+        }
+
+        Slot& slot = wheel[0][currentTick & slotMask];
+        for (auto& entry : slot) {
+            due.push_back(move(entry.task));
+            index.erase(entry.id);
+        }
+        slot.clear();
+    }
+}
+
+size_t TimerWheel::advance(Clock::time_point now) {
+    vector<Task> due;
+    {
+        lock_guard<mutex> lock(wheelMutex);
+        collect(tickFor(now), due);
+    }
+
+    for (auto& task : due) {
+        try {
+            task();
+        } catch (const exception& e) {
+            cerr << "[Timers] Ошибка в таймере: " << e.what() << "\n";
+        }
+    }
+    return due.size();
+}
+
+uint64_t TimerWheel::nextWakeTick() const {
+    // Ближайшая непустая ячейка уровня 0 или граница круга, где пора пересыпать старший
+    for (uint64_t step = 1; step <= slots; step++) {
+        uint64_t candidate = currentTick + step;
+        if ((candidate & slotMask) == 0 || !wheel[0][candidate & slotMask].empty()) return candidate;
+    }
+    return currentTick + slots;
+}
+
+void TimerWheel::workerLoop() {
+    unique_lock<mutex> lock(wheelMutex);
+
+    while (running) {
+        if (index.empty()) {
+            // Таймеров нет - спим до schedule или stop
+            wake.wait(lock, [this]() { return !running || !index.empty(); });
+            continue;
+        }
+
+        // Просыпаемся к ближайшему делу, а не каждый tick. schedule/reschedule будят раньше -
+        // тогда просто пересчитаем
+        wake.wait_until(lock, origin + tick * nextWakeTick());
+        if (!running) break;
+
+        lock.unlock();
+        advance(Clock::now());
+        lock.lock();
+    }
+}
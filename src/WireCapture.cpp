@@ -0,0 +1,305 @@
+//
+//  WireCapture.cpp
+//  Parking
+//
+
+#include "WireCapture.hpp"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+// MARK: Формат
+
+static void putLittleEndian(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static uint64_t getLittleEndian(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+bool WireCapture::load(const string& path, vector<Record>& records) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        cerr << "[Capture] Не удалось открыть " << path << "\n";
+        return false;
+    }
+
+    // Версия - последний байт магии. В первой не было канала, там только шлагбаум
+    uint8_t header[sizeof(magic)];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, magic, sizeof(magic) - 1) != 0
+        || header[sizeof(magic) - 1] < 1 || header[sizeof(magic) - 1] > magic[sizeof(magic) - 1]) {
+        cerr << "[Capture] " << path << " - не файл захвата\n";
+        fclose(file);
+        return false;
+    }
+    bool withChannel = header[sizeof(magic) - 1] >= 2;
+    size_t headerSize = withChannel ? recordHeaderSize : recordHeaderSize - 1;
+
+    records.clear();
+    uint8_t recordHeader[recordHeaderSize];
+    while (fread(recordHeader, 1, headerSize, file) == headerSize) {
+        Record record;
+        record.timeUs = getLittleEndian(recordHeader, 8);
+        const uint8_t* rest = recordHeader + 8;
+        if (withChannel) {
+            record.channel = static_cast<Channel>(*rest++);
+        }
+        record.direction = static_cast<Direction>(rest[0]);
+        record.data.resize(getLittleEndian(rest + 1, 2));
+
+        // Обрезанный хвост (процесс убили посреди записи) - просто конец
+        if (fread(record.data.data(), 1, record.data.size(), file) != record.data.size()) break;
+        records.push_back(move(record));
+    }
+
+    fclose(file);
+    return true;
+}
+
+// MARK: Запись
+
+CaptureTransport::CaptureTransport(ICommunication& port) : inner(&port), recording(false), recordsCount(0), droppedCount(0) {}
+
+CaptureTransport::CaptureTransport() : inner(nullptr), recording(false), recordsCount(0), droppedCount(0) {}
+
+CaptureTransport::~CaptureTransport() {
+    stop();
+}
+
+bool CaptureTransport::start(const string& path) {
+    if (recording) return false;
+
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cerr << "[Capture] Не удалось создать " << path << "\n";
+        return false;
+    }
+    fwrite(WireCapture::magic, 1, sizeof(WireCapture::magic), file);
+
+    ring.clear();
+    stopping = false;
+    recordsCount = 0;
+    droppedCount = 0;
+    startedAt = chrono::steady_clock::now();
+    writer = thread([this]() { writerLoop(); });
+    recording = true;
+
+    cout << "[Capture] Пишем обмен в " << path << "\n";
+    return true;
+}
+
+void CaptureTransport::stop() {
+    if (!recording) return;
+    recording = false;
+
+    {
+        lock_guard<mutex> lock(writerMutex);
+        stopping = true;
+    }
+    writerWake.notify_one();
+    writer.join();
+
+    // Кто успел положить запись до остановки - тоже в файл
+    while (producerBusy.test_and_set(memory_order_acquire)) {}
+    producerBusy.clear(memory_order_release);
+    drainToFile();
+
+    fclose(file);
+    file = nullptr;
+    cout << "[Capture] Записано " << recordsCount << " записей, потеряно " << droppedCount << "\n";
+}
+
+void CaptureTransport::record(WireCapture::Channel channel, WireCapture::Direction direction, const uint8_t* data, size_t length,
+                              chrono::steady_clock::time_point at) {
+    if (!recording || length == 0) return;
+    length = min<size_t>(length, 0xFFFF);
+
+    uint8_t header[WireCapture::recordHeaderSize];
+    uint64_t timeUs = chrono::duration_cast<chrono::microseconds>(max(at, startedAt) - startedAt).count();
+    putLittleEndian(header, timeUs, 8);
+    header[8] = static_cast<uint8_t>(channel);
+    header[9] = static_cast<uint8_t>(direction);
+    putLittleEndian(header + 10, length, 2);
+
+    while (producerBusy.test_and_set(memory_order_acquire)) {}
+
+    // Запись целиком или никак, иначе файл не разобрать
+    if (ring.freeSpace() >= sizeof(header) + length) {
+        ring.push(header, sizeof(header));
+        ring.push(data, length);
+        recordsCount++;
+    } else {
+        droppedCount++;
+    }
+
+    producerBusy.clear(memory_order_release);
+}
+
+void CaptureTransport::drainToFile() {
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = ring.pop(chunk, sizeof(chunk))) > 0) {
+        fwrite(chunk, 1, n, file);
+    }
+}
+
+void CaptureTransport::writerLoop() {
+    unique_lock<mutex> lock(writerMutex);
+
+    while (!stopping) {
+        // Будить писателя из I/O потока не нужно - сам заглядывает в кольцо
+        writerWake.wait_for(lock, chrono::milliseconds(50), [this]() { return stopping; });
+
+        lock.unlock();
+        drainToFile();
+        fflush(file);
+        lock.lock();
+    }
+}
+
+bool CaptureTransport::sendBytes(const uint8_t* data, size_t length) {
+    record(WireCapture::Channel::Gate, WireCapture::Direction::Tx, data, length);
+    return inner->sendBytes(data, length);
+}
+
+int CaptureTransport::readAvailable(uint8_t* buffer, int capacity, int timeoutMs) {
+    int n = inner->readAvailable(buffer, capacity, timeoutMs);
+    if (n > 0) {
+        record(WireCapture::Channel::Gate, WireCapture::Direction::Rx, buffer, static_cast<size_t>(n));
+    }
+    return n;
+}
+
+int CaptureTransport::readChunk(uint8_t* buffer, int capacity, int timeoutMs, chrono::steady_clock::time_point& arrivedAt) {
+    int n = inner->readChunk(buffer, capacity, timeoutMs, arrivedAt);
+    if (n > 0) {
+        record(WireCapture::Channel::Gate, WireCapture::Direction::Rx, buffer, static_cast<size_t>(n), arrivedAt);
+    }
+    return n;
+}
+
+// MARK: Проигрывание
+
+bool ReplayTransport::connect(const string& address) {
+    if (!WireCapture::load(address, records)) return false;
+    // Чужой канал (RFID) в обмен со шлагбаумом не попадает
+    records.erase(remove_if(records.begin(), records.end(), [this](const WireCapture::Record& record) {
+        return record.channel != channel;
+    }), records.end());
+    rewind();
+    return true;
+}
+
+void ReplayTransport::rewind() {
+    cursor = 0;
+    rxOffset = 0;
+    mismatches = 0;
+    skippedReplies = 0;
+    anchorUs = 0;
+    anchorTime = chrono::steady_clock::now();
+}
+
+chrono::steady_clock::time_point ReplayTransport::dueTime(const WireCapture::Record& record) const {
+    if (speed <= 0 || record.timeUs <= anchorUs) return anchorTime;
+
+    auto delay = chrono::microseconds(static_cast<int64_t>((record.timeUs - anchorUs) / speed));
+    return anchorTime + delay;
+}
+
+bool ReplayTransport::sendBytes(const uint8_t* data, size_t length) {
+    // Ответы, которые в записи пришли до этого запроса, нам уже не достанутся
+    while (cursor < records.size() && records[cursor].direction == WireCapture::Direction::Rx) {
+        skippedReplies++;
+        cursor++;
+    }
+    rxOffset = 0;
+    if (cursor >= records.size()) return false;
+
+    const auto& request = records[cursor];
+    if (request.data.size() != length || memcmp(request.data.data(), data, length) != 0) {
+        mismatches++;
+    }
+
+    // Задержки ответов дальше считаем от этой отправки
+    anchorUs = request.timeUs;
+    anchorTime = chrono::steady_clock::now();
+    cursor++;
+    return true;
+}
+
+int ReplayTransport::readAvailable(uint8_t* buffer, int capacity, int timeoutMs) {
+    if (cursor >= records.size()) return -1;
+
+    const auto& record = records[cursor];
+    if (record.direction != WireCapture::Direction::Rx) {
+        // Дальше в записи наш запрос - пока не отправим, ничего не придет
+        if (timeoutMs > 0) this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+        return 0;
+    }
+
+    auto due = dueTime(record);
+    auto limit = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    if (due > limit) {
+        this_thread::sleep_until(limit);
+        return 0;
+    }
+    this_thread::sleep_until(due);
+
+    size_t n = min(static_cast<size_t>(capacity), record.data.size() - rxOffset);
+    memcpy(buffer, record.data.data() + rxOffset, n);
+    rxOffset += n;
+
+    if (rxOffset == record.data.size()) {
+        cursor++;
+        rxOffset = 0;
+    }
+    return static_cast<int>(n);
+}
+
+const vector<uint8_t>* ReplayTransport::nextRequest() const {
+    for (size_t i = cursor; i < records.size(); i++) {
+        if (records[i].direction == WireCapture::Direction::Tx) return &records[i].data;
+    }
+    return nullptr;
+}
+
+// MARK: Проигрывание канала по времени
+
+bool CapturePlayer::load(const string& path) {
+    if (!WireCapture::load(path, records)) return false;
+    // Только то, что пришло по этому каналу - это и подаем в обработчик
+    records.erase(remove_if(records.begin(), records.end(), [this](const WireCapture::Record& record) {
+        return record.channel != channel || record.direction != WireCapture::Direction::Rx;
+    }), records.end());
+    rewind();
+    return true;
+}
+
+void CapturePlayer::rewind() {
+    cursor = 0;
+    startedAt = chrono::steady_clock::now();
+}
+
+size_t CapturePlayer::playDue(const Sink& sink) {
+    size_t played = 0;
+    auto elapsedUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startedAt).count();
+
+    while (cursor < records.size()) {
+        const auto& record = records[cursor];
+        if (speed > 0 && record.timeUs / speed > elapsedUs) break;
+
+        cursor++;
+        played++;
+        sink(record.data.data(), record.data.size());
+    }
+    return played;
+}